@@ -25,22 +25,22 @@ class GUIToPricingListener;
 */
 
 template <typename T>
-class GUIService : Service<string, Price<T>> {
+class GUIService : public Service<string, Price<T>> {
 
 private:
-    map<string, Price<T>> GUIs;
+    ProductMap<Price<T>> GUIs;
     vector<ServiceListener<Price<T>>*>listeners;
     GUIConnector<T>* connector;
     ServiceListener<Price<T>>* listener;
 
     int accelerator;
-    int time;
+    long long time; // milliseconds since the epoch of the last publish
 
 public:
 
     //Ctor and Dtor
     GUIService(){
-        GUIs = map<string, Price<T>>();
+        GUIs = ProductMap<Price<T>>();
         listeners = vector<ServiceListener<Price<T>>*>();
         connector = new GUIConnector<T>(this);
         listener = new GUIToPricingListener<T>(this);
@@ -57,9 +57,13 @@ public:
 
     // call back function for the connector
     void OnMessage(Price<T>& _data){
+        TRACE_SCOPE("GUIService::OnMessage");
+        TRACE_PRODUCT(_data.GetProduct());
         // publish the data
+        this->metrics.CountIn();
         string product_id = _data.GetProduct().GetProductId();
         GUIs[product_id] = _data;
+        this->metrics.SetStateSize(GUIs.Size());
         connector->Publish(_data);
     }
 
@@ -88,7 +92,7 @@ public:
         return accelerator;
     }
 
-    int GetTime() const
+    long long GetTime() const
     {
         return time;
     }
@@ -98,7 +102,7 @@ public:
         accelerator = acc;
     }
 
-    void SetTime(int t)
+    void SetTime(long long t)
     {
         time = t;
     }
@@ -116,9 +120,6 @@ public:
     // publish the data, save the records
     void Publish(Price<T>& _data);
 
-    // subscribe data from connector (not needed)
-    void Subscribe(ifstream& _data) {};
-
 private:
     GUIService<T>* service;
 };
@@ -126,13 +127,10 @@ private:
 template<typename T>
 void GUIConnector<T>::Publish(Price<T>& data){
     int accelerator = service->GetAccelerator();
-    int time = service->GetTime();
-    int currentTime = GetTime();
+    long long time = service->GetTime();
 
-    // update time
-    while (currentTime < time) {
-        currentTime += 1000;
-    }
+    // throttle on the clock in use, so a replay throttles on event time
+    long long currentTime = ClockNow() / 1000000;
     if (currentTime - time >= accelerator)
     {
         service->SetTime(currentTime);
@@ -146,6 +144,11 @@ void GUIConnector<T>::Publish(Price<T>& data){
             _file << s << ",";
         }
         _file << "\n";
+        this->metrics.CountOut();
+    }
+    else
+    {
+        this->metrics.CountThrottled();
     }
 }
 
@@ -166,6 +169,8 @@ public:
 
     // Process an add event to the Service
     void ProcessAdd(Price<T>& _data){
+        TRACE_SCOPE("GUIToPricingListener::ProcessAdd");
+        TRACE_PRODUCT(_data.GetProduct());
         service->OnMessage(_data);
     }
 
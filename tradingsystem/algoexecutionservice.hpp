@@ -10,6 +10,8 @@
 #include "soa.hpp"
 #include "marketdataservice.hpp"
 #include "utilities.hpp"
+#include "compactmessages.hpp"
+#include "snapshot.hpp"
 
 enum OrderType { FOK, IOC, MARKET, LIMIT, STOP };
 
@@ -59,6 +61,10 @@ public:
 	// Store attributes as strings
 	vector<string> ToStrings() const;
 
+	// Convert to and from the fixed layout
+	CompactExecutionOrder ToCompact() const;
+	static ExecutionOrder<T> FromCompact(const CompactExecutionOrder& _compact);
+
 private:
 	T product;
 	PricingSide side;
@@ -182,6 +188,31 @@ vector<string> ExecutionOrder<T>::ToStrings() const
 	return _strings;
 }
 
+template<typename T>
+CompactExecutionOrder ExecutionOrder<T>::ToCompact() const
+{
+	CompactExecutionOrder _compact;
+	memset(&_compact, 0, sizeof(_compact));
+	_compact.orderId.Set(orderId);
+	_compact.parentOrderId.Set(parentOrderId);
+	_compact.product = GetProductHandle(product.GetProductId());
+	_compact.price = PriceToTicks(price);
+	_compact.visibleQuantity = visibleQuantity;
+	_compact.hiddenQuantity = static_cast<int64_t>(hiddenQuantity);
+	_compact.side = static_cast<uint8_t>(side);
+	_compact.orderType = static_cast<uint8_t>(orderType);
+	_compact.isChildOrder = isChildOrder ? 1 : 0;
+	return _compact;
+}
+
+template<typename T>
+ExecutionOrder<T> ExecutionOrder<T>::FromCompact(const CompactExecutionOrder& _compact)
+{
+	return ExecutionOrder<T>(RetrieveProductByHandle(_compact.product), static_cast<PricingSide>(_compact.side),
+		_compact.orderId.Get(), static_cast<OrderType>(_compact.orderType), TicksToPrice(_compact.price),
+		double(_compact.visibleQuantity), double(_compact.hiddenQuantity), _compact.parentOrderId.Get(), _compact.isChildOrder != 0);
+}
+
 /* Declaration of the algo execution class
 coming from an execution order*/
 template<typename T>
@@ -252,8 +283,14 @@ public:
 	// Execute an order on a market
 	void AlgoOrderExecution(OrderBook<T>& _orderBook);
 
+	// Save the execution counters to a snapshot
+	void SaveSnapshot(SnapshotWriter& _writer);
+
+	// Restore the execution counters from a snapshot
+	void LoadSnapshot(SnapshotReader& _reader);
+
 private:
-	map<string, AlgoExecution<T>> algoExecutions;
+	ProductMap<AlgoExecution<T>> algoExecutions;
 	vector<ServiceListener<AlgoExecution<T>>*> listeners;
 	AlgoExecutionToMarketDataListener<T>* listener;
 	double SPREAD_LIMIT;
@@ -265,7 +302,7 @@ private:
 template<typename T>
 AlgoExecutionService<T>::AlgoExecutionService()
 {
-	algoExecutions = map<string, AlgoExecution<T>>();
+	algoExecutions = ProductMap<AlgoExecution<T>>();
 	listeners = vector<ServiceListener<AlgoExecution<T>>*>();
 	listener = new AlgoExecutionToMarketDataListener<T>(this);
 	SPREAD_LIMIT = 1.0 / 128.0;
@@ -284,8 +321,12 @@ AlgoExecution<T>& AlgoExecutionService<T>::GetData(string _id)
 template<typename T>
 void AlgoExecutionService<T>::OnMessage(AlgoExecution<T>& _data)
 {
+	TRACE_SCOPE("AlgoExecutionService::OnMessage");
+	TRACE_PRODUCT(_data.GetExecutionOrder()->GetProduct());
+	this->metrics.CountIn();
 	string _id = _data.GetExecutionOrder()->GetProduct().GetProductId();
 	algoExecutions[_id] = _data;
+	this->metrics.SetStateSize(algoExecutions.Size());
 }
 
 template<typename T>
@@ -311,6 +352,7 @@ AlgoExecutionToMarketDataListener<T>* AlgoExecutionService<T>::GetListener()
 template<typename T>
 void AlgoExecutionService<T>::AlgoOrderExecution(OrderBook<T>& _orderBook)
 {
+	this->metrics.CountIn();
 	T _product = _orderBook.GetProduct();
 	string _productId = _product.GetProductId();
 	PricingSide _side;
@@ -345,8 +387,10 @@ void AlgoExecutionService<T>::AlgoOrderExecution(OrderBook<T>& _orderBook)
 
 		AlgoExecution<T> algoOrder(_product, _side, _orderId, MARKET, _price, _quantity, 0, "PARENT_ORDER_ID", false);
 		algoExecutions[_productId] = algoOrder;
+		this->metrics.SetStateSize(algoExecutions.Size());
 
 		// notify the listners of the execution
+		FanOutTimer _timer(this->metrics);
 		for (auto& l : listeners)
 		{
 			l->ProcessAdd(algoOrder);
@@ -354,6 +398,20 @@ void AlgoExecutionService<T>::AlgoOrderExecution(OrderBook<T>& _orderBook)
 	}
 }
 
+template<typename T>
+void AlgoExecutionService<T>::SaveSnapshot(SnapshotWriter& _writer)
+{
+	_writer.BeginSection("ALGO");
+	_writer.Write(static_cast<int64_t>(executionCount));
+}
+
+template<typename T>
+void AlgoExecutionService<T>::LoadSnapshot(SnapshotReader& _reader)
+{
+	_reader.BeginSection("ALGO");
+	executionCount = static_cast<long>(_reader.Read<int64_t>());
+}
+
 /**
 * The service listener connection algoexecution to marketdata listener
 */
@@ -387,6 +445,8 @@ AlgoExecutionToMarketDataListener<T>::AlgoExecutionToMarketDataListener(AlgoExec
 template<typename T>
 void AlgoExecutionToMarketDataListener<T>::ProcessAdd(OrderBook<T>& _data)
 {
+	TRACE_SCOPE("AlgoExecutionToMarketDataListener::ProcessAdd");
+	TRACE_PRODUCT(_data.GetProduct());
 	// request the order execution
 	service->AlgoOrderExecution(_data);
 }
@@ -10,6 +10,7 @@
 
 #include "soa.hpp"
 #include "utilities.hpp"
+#include "compactmessages.hpp"
 #include "marketdataservice.hpp"
 #include "pricingservice.hpp"
 
@@ -116,6 +117,26 @@ public:
         return streamDetails;
     }
 
+    // Convert to and from the fixed layout
+    CompactPriceStream ToCompact() const{
+        CompactPriceStream _compact;
+        memset(&_compact, 0, sizeof(_compact));
+        _compact.product = GetProductHandle(product.GetProductId());
+        _compact.bidPrice = PriceToTicks(bidOrder.GetPrice());
+        _compact.offerPrice = PriceToTicks(offerOrder.GetPrice());
+        _compact.bidVisibleQuantity = bidOrder.GetVisibleQuantity();
+        _compact.bidHiddenQuantity = bidOrder.GetHiddenQuantity();
+        _compact.offerVisibleQuantity = offerOrder.GetVisibleQuantity();
+        _compact.offerHiddenQuantity = offerOrder.GetHiddenQuantity();
+        return _compact;
+    }
+
+    static PriceStream<T> FromCompact(const CompactPriceStream& _compact){
+        PriceStreamOrder _bid(TicksToPrice(_compact.bidPrice), _compact.bidVisibleQuantity, _compact.bidHiddenQuantity, BID);
+        PriceStreamOrder _offer(TicksToPrice(_compact.offerPrice), _compact.offerVisibleQuantity, _compact.offerHiddenQuantity, OFFER);
+        return PriceStream<T>(RetrieveProductByHandle(_compact.product), _bid, _offer);
+    }
+
 private:
     T product;
     PriceStreamOrder bidOrder;
@@ -173,7 +194,7 @@ public:
 
     // Ctor
     AlgoStreamingService(){
-        algoStreams = map<string, AlgoStream<T>>();
+        algoStreams = ProductMap<AlgoStream<T>>();
         listeners = vector<ServiceListener<AlgoStream<T>>*>();
         listener = new AlgoStreamingToPricingListener<T>(this);
         pricePublishCount = 0;
@@ -187,8 +208,12 @@ public:
 
     // Callback for any new or updated data
     void OnMessage(AlgoStream<T>& _data){
+        TRACE_SCOPE("AlgoStreamingService::OnMessage");
+        TRACE_PRODUCT(_data.GetPriceStream()->GetProduct());
+        this->metrics.CountIn();
         string _id = _data.GetPriceStream()->GetProduct().GetProductId();
         algoStreams[_id] = _data;
+        this->metrics.SetStateSize(algoStreams.Size());
     }
 
     // Add a listener to the Service for callbacks on add, remove, and update events for data to the Service
@@ -209,11 +234,18 @@ public:
     // Publish two-way prices
     void AlgoPublishPrice(Price<T>& _price);
 
+    // Publish two-way prices for a run of prices, handing the streams to each listener at once
+    void AlgoPublishPriceBatch(Span<Price<T>> _prices);
+
 private:
-    map<string, AlgoStream<T>> algoStreams;
+    // Make the stream of a price
+    AlgoStream<T> MakeAlgoStream(Price<T>& _price);
+
+    ProductMap<AlgoStream<T>> algoStreams;
     vector<ServiceListener<AlgoStream<T>>*> listeners;
     ServiceListener<Price<T>>* listener;
     long pricePublishCount;
+    vector<AlgoStream<T>> batch;
 };
 
 /**
@@ -229,8 +261,35 @@ long calculateVisibleQuantity(int count) {
 
 template<typename T>
 void AlgoStreamingService<T>::AlgoPublishPrice(Price<T>& price) {
-    T product = price.GetProduct();
-    string productId = product.GetProductId();
+    this->metrics.CountIn();
+    AlgoStream<T> algoStream = MakeAlgoStream(price);
+    this->metrics.SetStateSize(algoStreams.Size());
+
+    FanOutTimer _timer(this->metrics);
+    for (auto& listener : listeners) {
+        listener->ProcessAdd(algoStream);
+    }
+}
+
+template<typename T>
+void AlgoStreamingService<T>::AlgoPublishPriceBatch(Span<Price<T>> prices) {
+    this->metrics.CountIn(prices.size());
+    batch.clear();
+    for (auto& price : prices) {
+        batch.push_back(MakeAlgoStream(price));
+    }
+    this->metrics.SetStateSize(algoStreams.Size());
+
+    FanOutTimer _timer(this->metrics, batch.size());
+    for (auto& listener : listeners) {
+        listener->ProcessAddBatch(Span<AlgoStream<T>>(batch));
+    }
+}
+
+template<typename T>
+AlgoStream<T> AlgoStreamingService<T>::MakeAlgoStream(Price<T>& price) {
+    const T& product = price.GetProduct();
+    const string& productId = product.GetProductId();
 
     double midPrice = price.GetMid();
     double spread = price.GetBidOfferSpread();
@@ -245,10 +304,7 @@ void AlgoStreamingService<T>::AlgoPublishPrice(Price<T>& price) {
     PriceStreamOrder offerOrder(offerPrice, visibleQuantity, hiddenQuantity, OFFER);
     AlgoStream<T> algoStream(product, bidOrder, offerOrder);
     algoStreams[productId] = algoStream;
-
-    for (auto& listener : listeners) {
-        listener->ProcessAdd(algoStream);
-    }
+    return algoStream;
 }
 
 
@@ -272,9 +328,17 @@ public:
 
     // Process an add event to the Service
     void ProcessAdd(Price<T>& _data){
+        TRACE_SCOPE("AlgoStreamingToPricingListener::ProcessAdd");
+        TRACE_PRODUCT(_data.GetProduct());
         service->AlgoPublishPrice(_data);
     }
 
+    // Process a run of add events to the Service
+    void ProcessAddBatch(Span<Price<T>> _data){
+        TRACE_SCOPE("AlgoStreamingToPricingListener::ProcessAddBatch");
+        service->AlgoPublishPriceBatch(_data);
+    }
+
     // Process a remove event to the Service
     void ProcessRemove(Price<T>& _data) {}
 
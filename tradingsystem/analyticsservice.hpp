@@ -0,0 +1,524 @@
+/**
+ * analyticsservice.hpp
+ * Defines the data types and Service for bond yield analytics.
+ * Yields, durations and convexities are solved from PricingService mids.
+ *
+ * @author Lexie Zhu
+ */
+#ifndef ANALYTICS_SERVICE_HPP
+#define ANALYTICS_SERVICE_HPP
+
+#include <cmath>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <map>
+#include "soa.hpp"
+#include "utilities.hpp"
+#include "pricingservice.hpp"
+
+using namespace std;
+
+// number of bonds solved side by side in one kernel block
+const int ANALYTICS_LANES = 4;
+// Newton iterations allowed per solve; warm starts usually need one or two
+const int MAX_NEWTON_ITERATIONS = 8;
+const double YIELD_TOLERANCE = 1e-12;
+const double FACE_VALUE = 100.0;
+
+/**
+ * Yield analytics of a bond at its latest mid price.
+ * Yields are semi-annual bond equivalent, durations are in years.
+ * Type T is the product type.
+ */
+template<typename T>
+class BondAnalytics
+{
+
+public:
+
+    // ctor for the analytics
+    BondAnalytics() = default;
+    BondAnalytics(const T& _product, double _price, double _yield, double _macaulayDuration, double _modifiedDuration, double _convexity, double _dv01) :
+            product(_product), price(_price), yield(_yield), macaulayDuration(_macaulayDuration),
+            modifiedDuration(_modifiedDuration), convexity(_convexity), dv01(_dv01) {}
+
+    // Get the product
+    const T& GetProduct() const { return product; }
+
+    // Get the clean price the analytics were solved from
+    double GetPrice() const { return price; }
+
+    // Get the yield to maturity
+    double GetYield() const { return yield; }
+
+    // Get the Macaulay duration
+    double GetMacaulayDuration() const { return macaulayDuration; }
+
+    // Get the modified duration
+    double GetModifiedDuration() const { return modifiedDuration; }
+
+    // Get the convexity
+    double GetConvexity() const { return convexity; }
+
+    // Get the dollar value of a basis point per 100 face
+    double GetDV01() const { return dv01; }
+
+    // Change attributes to strings
+    vector<string> ToStrings() const {
+        return vector<string>{
+                product.GetProductId(),
+                PriceToString(price),
+                to_string(yield),
+                to_string(macaulayDuration),
+                to_string(modifiedDuration),
+                to_string(convexity),
+                to_string(dv01)
+        };
+    }
+
+private:
+    T product;
+    double price;
+    double yield;
+    double macaulayDuration;
+    double modifiedDuration;
+    double convexity;
+    double dv01;
+
+};
+
+/**
+ * Batched price/yield solver.
+ * Cash-flow schedules are precomputed once per bond and stored structure-of-arrays,
+ * ANALYTICS_LANES bonds per block with flows laid out [flow][lane], so every inner
+ * loop runs across lanes and is vectorized by the compiler.
+ * Each solve is a Newton iteration warm-started from the previous yield of the lane.
+ */
+class YieldKernel
+{
+
+public:
+
+    // ctor; cash flows are discounted to the settlement date
+    YieldKernel(const date& _settlement) : settlement(_settlement), laidOut(0) {}
+
+    // Add a semi-annual fixed coupon bond, returns its slot
+    int AddBond(double _coupon, const date& _maturity);
+
+    // Set the clean price of a slot
+    void SetPrice(int _slot, double _cleanPrice) { cleanPrices[_slot] = _cleanPrice; }
+
+    // Solve all bonds of the block holding the slot
+    void SolveBlock(int _block);
+
+    // Solve every block
+    void SolveAll();
+
+    // Get the number of bonds held
+    int GetSize() const { return static_cast<int>(coupons.size()); }
+
+    // Results of the last solve
+    double GetCleanPrice(int _slot) const { return cleanPrices[_slot]; }
+    double GetYield(int _slot) const { return yields[_slot]; }
+    double GetMacaulayDuration(int _slot) const { return macaulayDurations[_slot]; }
+    double GetModifiedDuration(int _slot) const { return modifiedDurations[_slot]; }
+    double GetConvexity(int _slot) const { return convexities[_slot]; }
+    double GetDV01(int _slot) const { return dv01s[_slot]; }
+
+private:
+
+    // Lay out the blocks holding bonds added since the last layout
+    void Build();
+
+    date settlement;
+    int laidOut;
+
+    // per bond inputs and outputs
+    vector<double> coupons;
+    vector<date> maturities;
+    vector<double> accrueds;
+    vector<double> cleanPrices;
+    vector<double> yields;
+    vector<double> macaulayDurations;
+    vector<double> modifiedDurations;
+    vector<double> convexities;
+    vector<double> dv01s;
+
+    // per bond schedules in periods from settlement, before layout
+    vector<vector<double>> scheduleTimes;
+    vector<vector<double>> scheduleAmounts;
+
+    // per block flow count and offset into the lane arrays
+    vector<int> blockFlows;
+    vector<int> blockOffsets;
+    vector<double> times;
+    vector<double> amounts;
+};
+
+int YieldKernel::AddBond(double _coupon, const date& _maturity)
+{
+    double _periodCoupon = _coupon / 2.0 * FACE_VALUE;
+
+    // walk back from maturity in half years to find the coupons after settlement
+    vector<date> _dates;
+    date _previous = _maturity;
+    for (int k = 0; _previous > settlement; k++) {
+        _dates.push_back(_previous);
+        _previous = _maturity - months(6 * (k + 1));
+    }
+
+    vector<double> _times;
+    vector<double> _amounts;
+    double _accrued = 0.0;
+    if (!_dates.empty()) {
+        date _next = _dates.back();
+        double _fraction = double((_next - settlement).days()) / double((_next - _previous).days());
+        _accrued = _periodCoupon * (1.0 - _fraction);
+        for (size_t k = 0; k < _dates.size(); k++) {
+            _times.push_back(_fraction + double(k));
+            _amounts.push_back(_periodCoupon);
+        }
+        _amounts.back() += FACE_VALUE;
+    }
+
+    coupons.push_back(_coupon);
+    maturities.push_back(_maturity);
+    accrueds.push_back(_accrued);
+    cleanPrices.push_back(FACE_VALUE);
+    yields.push_back(_coupon);
+    macaulayDurations.push_back(0.0);
+    modifiedDurations.push_back(0.0);
+    convexities.push_back(0.0);
+    dv01s.push_back(0.0);
+    scheduleTimes.push_back(_times);
+    scheduleAmounts.push_back(_amounts);
+    return GetSize() - 1;
+}
+
+void YieldKernel::Build()
+{
+    // blocks before the first one with a new bond keep their layout, so adding a bond costs one block
+    int _first = laidOut / ANALYTICS_LANES;
+    int _blocks = (GetSize() + ANALYTICS_LANES - 1) / ANALYTICS_LANES;
+    int _offset = _first < static_cast<int>(blockOffsets.size()) ? blockOffsets[_first] : static_cast<int>(times.size());
+    blockFlows.resize(_blocks, 0);
+    blockOffsets.resize(_blocks, 0);
+
+    for (int b = _first; b < _blocks; b++) {
+        blockFlows[b] = 0;
+        for (int l = 0; l < ANALYTICS_LANES; l++) {
+            int _slot = b * ANALYTICS_LANES + l;
+            if (_slot < GetSize()) {
+                blockFlows[b] = max(blockFlows[b], static_cast<int>(scheduleTimes[_slot].size()));
+            }
+        }
+        blockOffsets[b] = _offset;
+        _offset += blockFlows[b] * ANALYTICS_LANES;
+    }
+
+    // short schedules and empty lanes are padded with zero cash flows
+    times.resize(_offset);
+    amounts.resize(_offset);
+    for (int b = _first; b < _blocks; b++) {
+        fill(times.begin() + blockOffsets[b], times.begin() + blockOffsets[b] + blockFlows[b] * ANALYTICS_LANES, 0.0);
+        fill(amounts.begin() + blockOffsets[b], amounts.begin() + blockOffsets[b] + blockFlows[b] * ANALYTICS_LANES, 0.0);
+        for (int l = 0; l < ANALYTICS_LANES; l++) {
+            int _slot = b * ANALYTICS_LANES + l;
+            if (_slot >= GetSize()) continue;
+            for (size_t f = 0; f < scheduleTimes[_slot].size(); f++) {
+                times[blockOffsets[b] + f * ANALYTICS_LANES + l] = scheduleTimes[_slot][f];
+                amounts[blockOffsets[b] + f * ANALYTICS_LANES + l] = scheduleAmounts[_slot][f];
+            }
+        }
+    }
+    laidOut = GetSize();
+}
+
+void YieldKernel::SolveBlock(int _block)
+{
+    if (laidOut < GetSize()) Build();
+
+    const int _flows = blockFlows[_block];
+    const double* _times = &times[blockOffsets[_block]];
+    const double* _amounts = &amounts[blockOffsets[_block]];
+    const int _first = _block * ANALYTICS_LANES;
+
+    double y[ANALYTICS_LANES];
+    double target[ANALYTICS_LANES];
+    for (int l = 0; l < ANALYTICS_LANES; l++) {
+        int _slot = min(_first + l, GetSize() - 1);
+        y[l] = yields[_slot];
+        target[l] = cleanPrices[_slot] + accrueds[_slot];
+    }
+
+    double pv[ANALYTICS_LANES];
+    double tpv[ANALYTICS_LANES];
+    double ttpv[ANALYTICS_LANES];
+    double v[ANALYTICS_LANES];
+    double df[ANALYTICS_LANES];
+    for (int it = 0; it <= MAX_NEWTON_ITERATIONS; it++) {
+        // flows fall a whole period apart, so only the first discount factor of a lane needs a power
+        for (int l = 0; l < ANALYTICS_LANES; l++) {
+            v[l] = 1.0 / (1.0 + y[l] / 2.0);
+            df[l] = _flows > 0 ? pow(v[l], _times[l]) : 0.0;
+            pv[l] = 0.0;
+            tpv[l] = 0.0;
+            ttpv[l] = 0.0;
+        }
+
+        // discount every flow of every lane, stepping each discount factor by one period
+        for (int f = 0; f < _flows; f++) {
+            const double* _t = _times + f * ANALYTICS_LANES;
+            const double* _a = _amounts + f * ANALYTICS_LANES;
+            for (int l = 0; l < ANALYTICS_LANES; l++) {
+                double _pv = _a[l] * df[l];
+                pv[l] += _pv;
+                tpv[l] += _t[l] * _pv;
+                ttpv[l] += _t[l] * (_t[l] + 1.0) * _pv;
+                df[l] *= v[l];
+            }
+        }
+        if (it == MAX_NEWTON_ITERATIONS) break;
+
+        // dP/dy = -t * P / (2 * (1 + y/2)), summed over flows
+        double _step = 0.0;
+        for (int l = 0; l < ANALYTICS_LANES; l++) {
+            double _slope = -0.5 * tpv[l] * v[l];
+            double _dy = _slope != 0.0 ? (pv[l] - target[l]) / _slope : 0.0;
+            y[l] -= _dy;
+            _step = max(_step, fabs(_dy));
+        }
+        if (_step < YIELD_TOLERANCE) break;
+    }
+
+    for (int l = 0; l < ANALYTICS_LANES && _first + l < GetSize(); l++) {
+        int _slot = _first + l;
+        double _v = v[l];
+        bool _priced = pv[l] > 0.0;
+        yields[_slot] = y[l];
+        macaulayDurations[_slot] = _priced ? tpv[l] / pv[l] / 2.0 : 0.0;
+        modifiedDurations[_slot] = macaulayDurations[_slot] * _v;
+        convexities[_slot] = _priced ? ttpv[l] * _v * _v / pv[l] / 4.0 : 0.0;
+        dv01s[_slot] = modifiedDurations[_slot] * pv[l] * 1e-4;
+    }
+}
+
+void YieldKernel::SolveAll()
+{
+    if (laidOut < GetSize()) Build();
+    for (size_t b = 0; b < blockFlows.size(); b++) {
+        SolveBlock(static_cast<int>(b));
+    }
+}
+
+/**
+* Pre-declearations
+*/
+template<typename T>
+class AnalyticsToPricingListener;
+
+/**
+ * Analytics Service solving yields and risk measures from mid prices.
+ * Keyed on product identifier.
+ * Type T is the product type.
+ */
+template<typename T>
+class AnalyticsService : public Service<string, BondAnalytics<T>>
+{
+
+private:
+    ProductMap<BondAnalytics<T>> analytics;
+    vector<ServiceListener<BondAnalytics<T>>*> listeners;
+    AnalyticsToPricingListener<T>* listener;
+    YieldKernel kernel;
+    ProductMap<int> slots;
+    vector<T> products; // by slot
+    vector<ProductHandle> handles; // by slot
+
+public:
+
+    // Ctor; analytics settle on the date of the clock unless told otherwise
+    AnalyticsService(date _settlement = GetClockDate()) : kernel(_settlement)
+    {
+        analytics = ProductMap<BondAnalytics<T>>();
+        listeners = vector<ServiceListener<BondAnalytics<T>>*>();
+        listener = new AnalyticsToPricingListener<T>(this);
+    }
+    ~AnalyticsService() = default;
+
+    // Get the analytics of a product_id
+    BondAnalytics<T>& GetData(string _key){
+        return analytics[_key];
+    }
+
+    // Callback for any new or updated data
+    void OnMessage(BondAnalytics<T>& _data){
+        TRACE_SCOPE("AnalyticsService::OnMessage");
+        TRACE_PRODUCT(_data.GetProduct());
+        this->metrics.CountIn();
+        analytics[_data.GetProduct().GetProductId()] = _data;
+        this->metrics.SetStateSize(analytics.Size());
+    }
+
+    // Add a listener to the Service for callbacks on add, remove, and update events for data to the Service
+    void AddListener(ServiceListener<BondAnalytics<T>>* _listener){
+        listeners.push_back(_listener);
+    }
+
+    //Get all the listeners
+    const vector<ServiceListener<BondAnalytics<T>>*>& GetListeners() const{
+        return listeners;
+    }
+
+    // Get the listener of the service
+    ServiceListener<Price<T>>* GetListener(){
+        return listener;
+    }
+
+    // Re-solve the block of the priced product and publish its analytics
+    void UpdatePrice(Price<T>& _price);
+
+    // Re-solve the blocks of a run of prices once each and publish their analytics;
+    // a product priced again within the run starts a new run, so every price gets its own analytics
+    void UpdatePriceBatch(Span<Price<T>> _prices);
+
+private:
+    // Get the kernel slot of a product, adding it on its first price
+    int GetSlot(const T& _product);
+
+    // Store the analytics of every slot of a solved block
+    void StoreBlock(int _block);
+
+    // prices of the run being solved
+    vector<Price<T>*> run;
+    vector<int> runSlots;
+    vector<int> runBlocks;
+    vector<BondAnalytics<T>> published;
+};
+
+template<typename T>
+int AnalyticsService<T>::GetSlot(const T& _product)
+{
+    ProductHandle _handle = GetProductHandle(_product.GetProductId());
+    int* _slot = slots.Find(_handle);
+    if (!_slot) {
+        _slot = &slots[_handle];
+        *_slot = kernel.AddBond(_product.GetCoupon(), _product.GetMaturityDate());
+        products.push_back(_product);
+        handles.push_back(_handle);
+    }
+    return *_slot;
+}
+
+template<typename T>
+void AnalyticsService<T>::StoreBlock(int _block)
+{
+    // the other lanes of the block were re-solved as well at no extra cost
+    int _last = min((_block + 1) * ANALYTICS_LANES, kernel.GetSize());
+    for (int s = _block * ANALYTICS_LANES; s < _last; s++) {
+        const T& _p = products[s];
+        BondAnalytics<T>& _stored = analytics[handles[s]];
+        _stored = BondAnalytics<T>(_p, kernel.GetCleanPrice(s), kernel.GetYield(s), kernel.GetMacaulayDuration(s),
+                kernel.GetModifiedDuration(s), kernel.GetConvexity(s), kernel.GetDV01(s));
+    }
+}
+
+template<typename T>
+void AnalyticsService<T>::UpdatePrice(Price<T>& _price)
+{
+    this->metrics.CountIn();
+    int _slot = GetSlot(_price.GetProduct());
+    int _block = _slot / ANALYTICS_LANES;
+
+    kernel.SetPrice(_slot, _price.GetMid());
+    kernel.SolveBlock(_block);
+    StoreBlock(_block);
+    this->metrics.SetStateSize(analytics.Size());
+
+    BondAnalytics<T>& _data = analytics[handles[_slot]];
+    FanOutTimer _timer(this->metrics);
+    for (auto& l : listeners) {
+        l->ProcessAdd(_data);
+    }
+}
+
+template<typename T>
+void AnalyticsService<T>::UpdatePriceBatch(Span<Price<T>> _prices)
+{
+    this->metrics.CountIn(_prices.size());
+    for (size_t i = 0; i < _prices.size(); ) {
+        // set the prices of a run of distinct products
+        run.clear();
+        runSlots.clear();
+        for (; i < _prices.size(); i++) {
+            int _slot = GetSlot(_prices[i].GetProduct());
+            if (find(runSlots.begin(), runSlots.end(), _slot) != runSlots.end()) break;
+            kernel.SetPrice(_slot, _prices[i].GetMid());
+            run.push_back(&_prices[i]);
+            runSlots.push_back(_slot);
+        }
+
+        // solve each block of the run once
+        runBlocks.clear();
+        for (int _slot : runSlots) runBlocks.push_back(_slot / ANALYTICS_LANES);
+        sort(runBlocks.begin(), runBlocks.end());
+        runBlocks.erase(unique(runBlocks.begin(), runBlocks.end()), runBlocks.end());
+        for (int _block : runBlocks) {
+            kernel.SolveBlock(_block);
+            StoreBlock(_block);
+        }
+
+        published.clear();
+        for (int _slot : runSlots) {
+            published.push_back(analytics[handles[_slot]]);
+        }
+        this->metrics.SetStateSize(analytics.Size());
+
+        FanOutTimer _timer(this->metrics, published.size());
+        for (auto& l : listeners) {
+            l->ProcessAddBatch(Span<BondAnalytics<T>>(published));
+        }
+    }
+}
+
+/**
+* Analytics Service Listener subscribing data from Pricing Service to Analytics Service.
+* Type T is the product type.
+*/
+template<typename T>
+class AnalyticsToPricingListener : public ServiceListener<Price<T>>
+{
+
+private:
+    AnalyticsService<T>* service;
+
+public:
+
+    // ctor
+    AnalyticsToPricingListener(AnalyticsService<T>* _service){
+        service = _service;
+    }
+
+    // Process an add event to the Service
+    void ProcessAdd(Price<T>& _data){
+        TRACE_SCOPE("AnalyticsToPricingListener::ProcessAdd");
+        TRACE_PRODUCT(_data.GetProduct());
+        service->UpdatePrice(_data);
+    }
+
+    // Process a run of add events to the Service
+    void ProcessAddBatch(Span<Price<T>> _data){
+        TRACE_SCOPE("AnalyticsToPricingListener::ProcessAddBatch");
+        service->UpdatePriceBatch(_data);
+    }
+
+    // Process a remove event to the Service
+    void ProcessRemove(Price<T>& /*_data*/) {}
+
+    // Process an update event to the Service
+    void ProcessUpdate(Price<T>& /*_data*/) {}
+
+};
+
+#endif
@@ -0,0 +1,82 @@
+/**
+ * archive.hpp
+ * Defines the append-only archive for records that reached a terminal state,
+ * and the retention policy deciding how many of them stay in a service's live map.
+ *
+ * @author Lexie Zhu
+ */
+#ifndef ARCHIVE_HPP
+#define ARCHIVE_HPP
+
+#include <string>
+#include <vector>
+#include <type_traits>
+#include "hashindex.hpp"
+
+using namespace std;
+
+/**
+ * Retention of terminal records in a live map.
+ * Terminal records beyond hotCapacity are moved to the archive, oldest first.
+ */
+struct RetentionPolicy
+{
+    size_t hotCapacity;
+};
+
+/**
+ * Append-only archive of compact records with its own id index.
+ * Type C is the compact record type.
+ */
+template<typename C>
+class RecordArchive
+{
+    static_assert(is_trivially_copyable<C>::value, "archived records must be trivially copyable");
+
+public:
+
+    // Append a record under its id, false if the id is already archived
+    bool Append(const string& _id, const C& _record);
+
+    // Find an archived record by id, false if absent
+    bool Find(const string& _id, C& _record) const;
+
+    // Is the id archived?
+    bool Contains(const string& _id) const;
+
+    // Get the number of archived records
+    size_t Size() const { return records.size(); }
+
+    // Get all archived records in archival order
+    const vector<C>& GetRecords() const { return records; }
+
+private:
+    vector<C> records;
+    OpenAddressingIndex index;
+};
+
+template<typename C>
+bool RecordArchive<C>::Append(const string& _id, const C& _record)
+{
+    if (!index.Insert(_id, static_cast<uint32_t>(records.size()))) return false;
+    records.push_back(_record);
+    return true;
+}
+
+template<typename C>
+bool RecordArchive<C>::Find(const string& _id, C& _record) const
+{
+    uint32_t _slot;
+    if (!index.Find(_id, _slot)) return false;
+    _record = records[_slot];
+    return true;
+}
+
+template<typename C>
+bool RecordArchive<C>::Contains(const string& _id) const
+{
+    uint32_t _slot;
+    return index.Find(_id, _slot);
+}
+
+#endif
@@ -0,0 +1,314 @@
+/**
+ * binaryhistory.hpp
+ * Defines the compressed binary history store and its reader.
+ * A file is a header followed by self-contained blocks of records. Within a block,
+ * record times are delta-encoded and fields are dictionary-encoded: a field seen before
+ * in the block is written as its code, a new one as a literal that takes the next code.
+ * The encoded block is then compressed with CompressBlock. Blocks are indexed like the
+ * text files, in <file>.idx, so queries decode only the blocks they need.
+ *
+ * @author Lexie Zhu
+ */
+#ifndef BINARY_HISTORY_HPP
+#define BINARY_HISTORY_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include <unordered_map>
+#include <stdexcept>
+#include <type_traits>
+#include "historystore.hpp"
+#include "blockcompression.hpp"
+
+using namespace std;
+
+const uint32_t HISTORY_FILE_MAGIC = 0x54534948; // "HIST"
+const uint32_t HISTORY_FILE_VERSION = 1;
+const uint32_t HISTORY_BLOCK_MAGIC = 0x4B4C4248; // "HBLK"
+
+// records per binary block; larger blocks compress better
+const long HISTORY_BINARY_BLOCK_RECORDS = 1024;
+
+/**
+ * Header of a binary history block, followed by compressedSize bytes.
+ */
+struct HistoryBlockHeader
+{
+    uint32_t magic;
+    uint32_t records;
+    uint32_t rawSize;
+    uint32_t compressedSize;
+    int64_t firstTime;
+    int64_t lastTime;
+};
+
+static_assert(is_trivially_copyable<HistoryBlockHeader>::value && sizeof(HistoryBlockHeader) == 32, "HistoryBlockHeader layout");
+
+/**
+ * A decoded historical record.
+ */
+struct HistoryRecord
+{
+    int64_t time;
+    ProductHandle product;
+    vector<string> fields;
+};
+
+/**
+ * Reader of a binary history file, block by block or through its index.
+ */
+class BinaryHistoryReader
+{
+
+public:
+
+    // ctor, opens and validates the file header
+    BinaryHistoryReader(const string& _path);
+
+    // Decode the next block in file order, false at the end of the file
+    bool NextBlock(vector<HistoryRecord>& _records);
+
+    // Decode the block at _offset
+    void ReadBlock(uint64_t _offset, vector<HistoryRecord>& _records);
+
+    // Get the records of a product between _from and _to, inclusive, through an index
+    vector<HistoryRecord> Query(const HistoryIndex& _index, ProductHandle _product, int64_t _from, int64_t _to);
+
+private:
+
+    // Decode the block at the current position, false if there is no complete block
+    bool Decode(vector<HistoryRecord>& _records);
+
+    ifstream file;
+    vector<char> compressed;
+    vector<char> raw;
+};
+
+BinaryHistoryReader::BinaryHistoryReader(const string& _path)
+{
+    file.open(_path, ios::binary);
+    if (!file) throw runtime_error("History: cannot open " + _path);
+    uint32_t _preamble[2];
+    file.read(reinterpret_cast<char*>(_preamble), sizeof(_preamble));
+    if (file.gcount() != sizeof(_preamble) || _preamble[0] != HISTORY_FILE_MAGIC) throw runtime_error("History: not a history file " + _path);
+    if (_preamble[1] != HISTORY_FILE_VERSION) throw runtime_error("History: unsupported version in " + _path);
+}
+
+bool BinaryHistoryReader::Decode(vector<HistoryRecord>& _records)
+{
+    _records.clear();
+    HistoryBlockHeader _header;
+    file.read(reinterpret_cast<char*>(&_header), sizeof(_header));
+    if (file.gcount() != sizeof(_header)) return false;
+    if (_header.magic != HISTORY_BLOCK_MAGIC) throw runtime_error("History: bad block");
+
+    // a block cut short by a crash ends the file
+    compressed.resize(_header.compressedSize);
+    file.read(compressed.data(), _header.compressedSize);
+    if (static_cast<size_t>(file.gcount()) != _header.compressedSize) return false;
+    DecompressBlock(compressed.data(), compressed.size(), _header.rawSize, raw);
+
+    vector<string> _dictionary;
+    size_t _pos = 0;
+    int64_t _time = _header.firstTime;
+    for (uint32_t r = 0; r < _header.records; r++)
+    {
+        HistoryRecord _record;
+        _time += ZigZagDecode(GetVarint(raw.data(), raw.size(), _pos)) * 1000000;
+        _record.time = _time;
+        _record.product = static_cast<ProductHandle>(GetVarint(raw.data(), raw.size(), _pos));
+        uint64_t _fields = GetVarint(raw.data(), raw.size(), _pos);
+        for (uint64_t f = 0; f < _fields; f++)
+        {
+            // code 0 is a literal, code n the n-th field of the dictionary
+            uint64_t _code = GetVarint(raw.data(), raw.size(), _pos);
+            if (_code == 0) {
+                uint64_t _length = GetVarint(raw.data(), raw.size(), _pos);
+                if (_length > raw.size() - _pos) throw runtime_error("History: bad literal");
+                _dictionary.emplace_back(raw.data() + _pos, _length);
+                _pos += _length;
+                _record.fields.push_back(_dictionary.back());
+            }
+            else {
+                if (_code > _dictionary.size()) throw runtime_error("History: bad dictionary code");
+                _record.fields.push_back(_dictionary[_code - 1]);
+            }
+        }
+        _records.push_back(move(_record));
+    }
+    return true;
+}
+
+bool BinaryHistoryReader::NextBlock(vector<HistoryRecord>& _records)
+{
+    return Decode(_records);
+}
+
+void BinaryHistoryReader::ReadBlock(uint64_t _offset, vector<HistoryRecord>& _records)
+{
+    file.clear();
+    file.seekg(_offset);
+    if (!Decode(_records)) throw runtime_error("History: no block at " + to_string(_offset));
+}
+
+vector<HistoryRecord> BinaryHistoryReader::Query(const HistoryIndex& _index, ProductHandle _product, int64_t _from, int64_t _to)
+{
+    vector<HistoryRecord> _found;
+    vector<HistoryRecord> _block;
+    for (auto& e : _index.Find(_product, _from, _to))
+    {
+        ReadBlock(e.offset, _block);
+        for (auto& r : _block) {
+            if (r.product == _product && r.time >= _from && r.time <= _to) _found.push_back(move(r));
+        }
+    }
+    return _found;
+}
+
+/**
+ * Compressed binary history file with its sparse index, written as records are persisted.
+ */
+class BinaryHistoryStore : public HistoryStore
+{
+
+public:
+
+    // ctor, appends to _path and its index at _path.idx
+    BinaryHistoryStore(const string& _path);
+
+    // dtor, closes the open block
+    ~BinaryHistoryStore();
+
+    void Append(const string& _productId, int64_t _time, const vector<string>& _fields) override;
+
+    void Flush() override;
+
+    vector<string> Query(const string& _productId, int64_t _from, int64_t _to) override;
+
+    // Get the index
+    const HistoryIndex& GetIndex() const { return index; }
+
+private:
+
+    // Compress, write and index the open block
+    void CloseBlock();
+
+    string path;
+    ofstream file;
+    ofstream indexFile;
+    HistoryIndex index;
+    uint64_t offset;
+
+    // the open block
+    vector<char> raw;
+    vector<char> compressed;
+    unordered_map<string, uint64_t> dictionary;
+    long blockRecords;
+    int64_t firstTime;
+    int64_t lastTime;
+    ProductMap<pair<int64_t, int64_t>> blockTimes;
+};
+
+BinaryHistoryStore::BinaryHistoryStore(const string& _path) : path(_path)
+{
+    // an index without the file it describes is stale
+    offset = filesystem::exists(path) ? filesystem::file_size(path) : 0;
+    if (offset == 0) {
+        ofstream(path + ".idx", ios::binary | ios::trunc);
+    }
+    index.Load(path + ".idx");
+    file.open(path, ios::binary | ios::app);
+    indexFile.open(path + ".idx", ios::binary | ios::app);
+    if (offset == 0) {
+        uint32_t _preamble[2] = { HISTORY_FILE_MAGIC, HISTORY_FILE_VERSION };
+        file.write(reinterpret_cast<const char*>(_preamble), sizeof(_preamble));
+        offset = sizeof(_preamble);
+    }
+    blockRecords = 0;
+    firstTime = lastTime = 0;
+}
+
+BinaryHistoryStore::~BinaryHistoryStore()
+{
+    Flush();
+}
+
+void BinaryHistoryStore::Append(const string& _productId, int64_t _time, const vector<string>& _fields)
+{
+    // times are kept to the millisecond, as in the text files
+    _time = _time / 1000000 * 1000000;
+    if (blockRecords == 0) firstTime = lastTime = _time;
+
+    ProductHandle _product = GetProductHandle(_productId);
+    PutVarint(raw, ZigZagEncode((_time - lastTime) / 1000000));
+    PutVarint(raw, _product);
+    PutVarint(raw, _fields.size());
+    for (auto& s : _fields)
+    {
+        auto _code = dictionary.find(s);
+        if (_code != dictionary.end()) {
+            PutVarint(raw, _code->second);
+            continue;
+        }
+        PutVarint(raw, 0);
+        PutVarint(raw, s.size());
+        raw.insert(raw.end(), s.begin(), s.end());
+        dictionary.emplace(s, dictionary.size() + 1);
+    }
+    lastTime = _time;
+
+    if (!blockTimes.Find(_product)) blockTimes[_product].first = _time;
+    blockTimes[_product].second = _time;
+    if (++blockRecords == HISTORY_BINARY_BLOCK_RECORDS) CloseBlock();
+}
+
+void BinaryHistoryStore::CloseBlock()
+{
+    if (blockRecords == 0) return;
+
+    compressed.clear();
+    CompressBlock(raw.data(), raw.size(), compressed);
+    HistoryBlockHeader _header = { HISTORY_BLOCK_MAGIC, static_cast<uint32_t>(blockRecords), static_cast<uint32_t>(raw.size()),
+        static_cast<uint32_t>(compressed.size()), firstTime, lastTime };
+    file.write(reinterpret_cast<const char*>(&_header), sizeof(_header));
+    file.write(compressed.data(), compressed.size());
+
+    uint32_t _length = static_cast<uint32_t>(sizeof(_header) + compressed.size());
+    for (ProductHandle h : blockTimes.GetHandles())
+    {
+        HistoryBlockEntry _entry = { h, _length, offset, blockTimes[h].first, blockTimes[h].second };
+        index.Add(_entry);
+        indexFile.write(reinterpret_cast<const char*>(&_entry), sizeof(_entry));
+    }
+    // the file is written out before the index entries pointing into it
+    file.flush();
+    indexFile.flush();
+
+    offset += _length;
+    raw.clear();
+    dictionary.clear();
+    blockTimes.Clear();
+    blockRecords = 0;
+}
+
+void BinaryHistoryStore::Flush()
+{
+    CloseBlock();
+}
+
+vector<string> BinaryHistoryStore::Query(const string& _productId, int64_t _from, int64_t _to)
+{
+    Flush();
+    vector<string> _lines;
+    ProductHandle _product;
+    if (!FindProductHandle(_productId, _product)) return _lines;
+    BinaryHistoryReader _reader(path);
+    for (auto& r : _reader.Query(index, _product, _from, _to)) {
+        _lines.push_back(FormatHistoryLine(r.time, r.fields));
+    }
+    return _lines;
+}
+
+#endif
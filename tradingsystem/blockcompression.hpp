@@ -0,0 +1,118 @@
+/**
+ * blockcompression.hpp
+ * Defines varint coding and the LZ77-style block compressor used by binary storage.
+ * A compressed block is a run of sequences: a literal length, the literals, then a match
+ * length and offset copying earlier output. The last sequence has literals only.
+ *
+ * @author Lexie Zhu
+ */
+#ifndef BLOCK_COMPRESSION_HPP
+#define BLOCK_COMPRESSION_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <stdexcept>
+
+using namespace std;
+
+// Append an unsigned varint, seven bits per byte
+void PutVarint(vector<char>& _out, uint64_t _value)
+{
+    while (_value >= 0x80) {
+        _out.push_back(static_cast<char>(_value | 0x80));
+        _value >>= 7;
+    }
+    _out.push_back(static_cast<char>(_value));
+}
+
+// Read an unsigned varint at _pos, moving _pos past it
+uint64_t GetVarint(const char* _data, size_t _size, size_t& _pos)
+{
+    uint64_t _value = 0;
+    for (int _shift = 0; _shift < 64; _shift += 7) {
+        if (_pos >= _size) throw runtime_error("Varint: truncated");
+        uint8_t _byte = static_cast<uint8_t>(_data[_pos++]);
+        _value |= uint64_t(_byte & 0x7F) << _shift;
+        if (!(_byte & 0x80)) return _value;
+    }
+    throw runtime_error("Varint: too long");
+}
+
+// Map signed to unsigned so small deltas of either sign stay short
+uint64_t ZigZagEncode(int64_t _value)
+{
+    return (static_cast<uint64_t>(_value) << 1) ^ static_cast<uint64_t>(_value >> 63);
+}
+
+int64_t ZigZagDecode(uint64_t _value)
+{
+    return static_cast<int64_t>(_value >> 1) ^ -static_cast<int64_t>(_value & 1);
+}
+
+const int COMPRESSION_HASH_BITS = 14;
+const size_t COMPRESSION_MIN_MATCH = 4;
+const size_t COMPRESSION_MAX_OFFSET = 1 << 16;
+
+// Compress _size bytes at _data, appending to _out
+void CompressBlock(const char* _data, size_t _size, vector<char>& _out)
+{
+    vector<int64_t> _table(size_t(1) << COMPRESSION_HASH_BITS, -1);
+    size_t _anchor = 0;
+    size_t i = 0;
+    while (i + COMPRESSION_MIN_MATCH <= _size)
+    {
+        uint32_t _word;
+        memcpy(&_word, _data + i, sizeof(_word));
+        size_t _slot = (_word * 2654435761u) >> (32 - COMPRESSION_HASH_BITS);
+        int64_t _candidate = _table[_slot];
+        _table[_slot] = static_cast<int64_t>(i);
+
+        if (_candidate < 0 || i - _candidate > COMPRESSION_MAX_OFFSET || memcmp(_data + _candidate, _data + i, COMPRESSION_MIN_MATCH) != 0) {
+            i++;
+            continue;
+        }
+
+        size_t _length = COMPRESSION_MIN_MATCH;
+        while (i + _length < _size && _data[_candidate + _length] == _data[i + _length]) _length++;
+
+        PutVarint(_out, i - _anchor);
+        _out.insert(_out.end(), _data + _anchor, _data + i);
+        PutVarint(_out, _length);
+        PutVarint(_out, i - _candidate);
+        i += _length;
+        _anchor = i;
+    }
+
+    // trailing literals, possibly none
+    PutVarint(_out, _size - _anchor);
+    _out.insert(_out.end(), _data + _anchor, _data + _size);
+}
+
+// Decompress a block of _rawSize bytes from _size bytes at _data into _out
+void DecompressBlock(const char* _data, size_t _size, size_t _rawSize, vector<char>& _out)
+{
+    _out.clear();
+    _out.reserve(_rawSize);
+    size_t _pos = 0;
+    while (true)
+    {
+        uint64_t _literals = GetVarint(_data, _size, _pos);
+        if (_literals > _size - _pos || _out.size() + _literals > _rawSize) throw runtime_error("DecompressBlock: bad literal run");
+        _out.insert(_out.end(), _data + _pos, _data + _pos + _literals);
+        _pos += _literals;
+        if (_out.size() == _rawSize) return;
+
+        uint64_t _length = GetVarint(_data, _size, _pos);
+        uint64_t _offset = GetVarint(_data, _size, _pos);
+        if (_offset == 0 || _offset > _out.size() || _out.size() + _length > _rawSize) throw runtime_error("DecompressBlock: bad match");
+
+        // byte by byte, a match may overlap the bytes it produces
+        size_t _from = _out.size() - _offset;
+        for (uint64_t k = 0; k < _length; k++) {
+            _out.push_back(_out[_from + k]);
+        }
+    }
+}
+
+#endif
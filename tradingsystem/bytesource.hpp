@@ -0,0 +1,351 @@
+/**
+ * bytesource.hpp
+ * Defines the byte sources Connectors subscribe to.
+ * A source hands out contiguous spans of complete newline-terminated records: a mapped file or
+ * an in-memory buffer in one span, a file descriptor (socket, pipe) a read at a time, a compressed
+ * feed a frame at a time. Connectors parse the records in place, so no source copies a record
+ * on its way to the Service.
+ *
+ * @author Lexie Zhu
+ */
+#ifndef BYTE_SOURCE_HPP
+#define BYTE_SOURCE_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <type_traits>
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define BYTE_SOURCE_POSIX 1
+#endif
+#include "blockcompression.hpp"
+#include "utilities.hpp"
+
+using namespace std;
+
+// Name of the last system error, after what failed
+string SystemError(const string& _what)
+{
+    return _what + ": " + strerror(errno);
+}
+
+// Take the next record off a span of records and split it into cells; false once the span is used up.
+// Blank lines are skipped and a trailing '\r' is dropped.
+bool NextRecord(string_view& _span, string_view& _record, vector<string_view>& _cells)
+{
+    while (!_span.empty()) {
+        size_t _newline = _span.find('\n');
+        _record = _span.substr(0, _newline);
+        _span.remove_prefix(_newline == string_view::npos ? _span.size() : _newline + 1);
+        if (!_record.empty() && _record.back() == '\r') _record.remove_suffix(1);
+        if (_record.empty()) continue;
+        SplitLine(_record, _cells);
+        return true;
+    }
+    return false;
+}
+
+// Split off the first _records records of a span, or all of it; returns how many were taken
+long TakeRecords(string_view& _span, long _records, string_view& _taken)
+{
+    size_t _end = 0;
+    long _count = 0;
+    while (_count < _records && _end < _span.size()) {
+        size_t _newline = _span.find('\n', _end);
+        _end = _newline == string_view::npos ? _span.size() : _newline + 1;
+        _count++;
+    }
+    _taken = _span.substr(0, _end);
+    _span.remove_prefix(_end);
+    return _count;
+}
+
+/**
+ * Source of spans of complete records.
+ */
+class ByteSource
+{
+
+public:
+
+    virtual ~ByteSource() {}
+
+    // Get the next span of complete records, valid until the next call; false at the end of the source.
+    // A source that would block hands out an empty span instead.
+    virtual bool Next(string_view& _span) = 0;
+};
+
+/**
+ * Records held in memory by the caller, handed out in one span.
+ */
+class MemorySource : public ByteSource
+{
+
+public:
+
+    // ctor
+    MemorySource(string_view _data) : data(_data), done(false) {}
+
+    bool Next(string_view& _span) override
+    {
+        if (done || data.empty()) return false;
+        done = true;
+        _span = data;
+        return true;
+    }
+
+private:
+    string_view data;
+    bool done;
+};
+
+/**
+ * A file mapped into memory and handed out in one span; pages are read as the records are parsed.
+ * Without mmap the file is read into memory instead.
+ */
+class MappedFileSource : public ByteSource
+{
+
+public:
+
+    // ctor, throws runtime_error if the file cannot be opened
+    MappedFileSource(const string& _path);
+    ~MappedFileSource();
+
+    MappedFileSource(const MappedFileSource&) = delete;
+    MappedFileSource& operator=(const MappedFileSource&) = delete;
+
+    bool Next(string_view& _span) override;
+
+    // Get the whole file
+    string_view GetData() const { return string_view(data, size); }
+
+private:
+    const char* data;
+    size_t size;
+    bool mapped;
+    vector<char> contents;
+    bool done;
+};
+
+MappedFileSource::MappedFileSource(const string& _path) : data(nullptr), size(0), mapped(false), done(false)
+{
+#ifdef BYTE_SOURCE_POSIX
+    int _fd = open(_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (_fd < 0) throw runtime_error(SystemError("open " + _path));
+    struct stat _stat;
+    if (fstat(_fd, &_stat) < 0) {
+        string _error = SystemError("stat " + _path);
+        close(_fd);
+        throw runtime_error(_error);
+    }
+    size = size_t(_stat.st_size);
+    if (size > 0) {
+        void* _map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, _fd, 0);
+        if (_map != MAP_FAILED) {
+            madvise(_map, size, MADV_SEQUENTIAL);
+            data = static_cast<const char*>(_map);
+            mapped = true;
+        }
+    }
+    close(_fd);
+    if (mapped || size == 0) return;
+#endif
+    // no mapping: read it all
+    ifstream _file(_path, ios::binary);
+    if (!_file) throw runtime_error("Cannot open " + _path);
+    contents.assign(istreambuf_iterator<char>(_file), istreambuf_iterator<char>());
+    data = contents.data();
+    size = contents.size();
+}
+
+MappedFileSource::~MappedFileSource()
+{
+#ifdef BYTE_SOURCE_POSIX
+    if (mapped) munmap(const_cast<char*>(data), size);
+#endif
+}
+
+bool MappedFileSource::Next(string_view& _span)
+{
+    if (done || size == 0) return false;
+    done = true;
+    _span = string_view(data, size);
+    return true;
+}
+
+#ifdef BYTE_SOURCE_POSIX
+
+// bytes a descriptor's buffer starts with; it doubles whenever one record does not fit
+const size_t FD_SOURCE_BUFFER_SIZE = 65536;
+
+/**
+ * A file descriptor such as a socket or a pipe, read into a buffer reused for the whole source.
+ * Each Next reads once and hands out the complete records read so far; a partial record waits
+ * at the front of the buffer for the rest. The last record may end without a newline.
+ */
+class FdSource : public ByteSource
+{
+
+public:
+
+    // ctor; the source closes the descriptor unless told otherwise
+    FdSource(int _fd, size_t _bufferSize = FD_SOURCE_BUFFER_SIZE, bool _owned = true) :
+        fd(_fd), owned(_owned), buffer(max(_bufferSize, size_t(1))), filled(0), consumed(0), ended(false) {}
+    ~FdSource() { if (owned && fd >= 0) close(fd); }
+
+    FdSource(const FdSource&) = delete;
+    FdSource& operator=(const FdSource&) = delete;
+
+    // throws runtime_error if the read fails
+    bool Next(string_view& _span) override;
+
+    int GetFd() const { return fd; }
+
+private:
+    int fd;
+    bool owned;
+    vector<char> buffer;
+    size_t filled;
+    size_t consumed;
+    bool ended;
+};
+
+bool FdSource::Next(string_view& _span)
+{
+    // the records handed out last time are done with; keep the partial one
+    if (consumed > 0) {
+        memmove(buffer.data(), buffer.data() + consumed, filled - consumed);
+        filled -= consumed;
+        consumed = 0;
+    }
+    if (ended) return false;
+    if (filled == buffer.size()) buffer.resize(buffer.size() * 2);
+
+    ssize_t _read = read(fd, buffer.data() + filled, buffer.size() - filled);
+    if (_read < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) throw runtime_error(SystemError("read"));
+        _span = string_view();
+        return true;
+    }
+    if (_read == 0) {
+        ended = true;
+        if (filled == 0) return false;
+        consumed = filled;
+        _span = string_view(buffer.data(), filled);
+        return true;
+    }
+
+    filled += _read;
+    size_t _newline = string_view(buffer.data(), filled).rfind('\n');
+    consumed = _newline == string_view::npos ? 0 : _newline + 1;
+    _span = string_view(buffer.data(), consumed);
+    return true;
+}
+
+#endif
+
+const uint32_t FEED_FRAME_MAGIC = 0x4B4C4246; // "FBLK"
+
+// bytes of records per frame of a compressed feed
+const size_t FEED_FRAME_SIZE = 1 << 20;
+
+/**
+ * Header of a frame of a compressed feed, followed by compressedSize bytes of a CompressBlock block
+ * holding rawSize bytes of whole records.
+ */
+struct FeedFrameHeader
+{
+    uint32_t magic;
+    uint32_t records;
+    uint32_t rawSize;
+    uint32_t compressedSize;
+};
+
+static_assert(is_trivially_copyable<FeedFrameHeader>::value && sizeof(FeedFrameHeader) == 16, "FeedFrameHeader layout");
+
+/**
+ * A compressed feed file, mapped and decompressed a frame at a time into a buffer reused for the whole feed.
+ */
+class CompressedSource : public ByteSource
+{
+
+public:
+
+    // ctor, throws runtime_error if the file cannot be opened
+    CompressedSource(const string& _path) : file(_path), position(0) {}
+
+    // throws runtime_error if a frame is corrupt
+    bool Next(string_view& _span) override;
+
+private:
+    MappedFileSource file;
+    size_t position;
+    vector<char> frame;
+};
+
+bool CompressedSource::Next(string_view& _span)
+{
+    string_view _data = file.GetData();
+    if (position == _data.size()) return false;
+
+    FeedFrameHeader _header;
+    if (_data.size() - position < sizeof(_header)) throw runtime_error("CompressedSource: truncated frame header");
+    memcpy(&_header, _data.data() + position, sizeof(_header));
+    position += sizeof(_header);
+    if (_header.magic != FEED_FRAME_MAGIC) throw runtime_error("CompressedSource: bad frame");
+    if (_data.size() - position < _header.compressedSize) throw runtime_error("CompressedSource: truncated frame");
+
+    DecompressBlock(_data.data() + position, _header.compressedSize, _header.rawSize, frame);
+    position += _header.compressedSize;
+    _span = string_view(frame.data(), frame.size());
+    return true;
+}
+
+// Compress the records of a stream into frames of about _frameSize bytes, returns the number of records written
+long WriteCompressedFeed(istream& _in, ostream& _out, size_t _frameSize = FEED_FRAME_SIZE)
+{
+    long _total = 0;
+    string _raw;
+    vector<char> _compressed;
+    uint32_t _records = 0;
+    auto _flush = [&]() {
+        if (_raw.empty()) return;
+        _compressed.clear();
+        CompressBlock(_raw.data(), _raw.size(), _compressed);
+        FeedFrameHeader _header{ FEED_FRAME_MAGIC, _records, uint32_t(_raw.size()), uint32_t(_compressed.size()) };
+        _out.write(reinterpret_cast<const char*>(&_header), sizeof(_header));
+        _out.write(_compressed.data(), _compressed.size());
+        _raw.clear();
+        _records = 0;
+    };
+
+    for (string _line; getline(_in, _line); ) {
+        _raw += _line;
+        _raw += '\n';
+        _records++;
+        _total++;
+        if (_raw.size() >= _frameSize) _flush();
+    }
+    _flush();
+    return _total;
+}
+
+// Open a feed file: compressed if it ends in .z, mapped otherwise; throws runtime_error if it cannot be opened
+unique_ptr<ByteSource> OpenFeedSource(const string& _path)
+{
+    if (_path.size() > 2 && _path.compare(_path.size() - 2, 2, ".z") == 0) return unique_ptr<ByteSource>(new CompressedSource(_path));
+    return unique_ptr<ByteSource>(new MappedFileSource(_path));
+}
+
+#endif
@@ -0,0 +1,310 @@
+/**
+ * channel.hpp
+ * Defines bounded channels between a Service and a listener running on its own thread.
+ * A channel holds at most its capacity; when it is full the overflow policy decides whether
+ * the producer waits, the oldest value is dropped, or values are conflated per product.
+ * Depth, high-water mark, drops, waits and coalesced values are counted, so an overloaded
+ * link shows up in its counters instead of in memory use.
+ *
+ * @author Lexie Zhu
+ */
+#ifndef CHANNEL_HPP
+#define CHANNEL_HPP
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include "soa.hpp"
+#include "productregistry.hpp"
+#include "utilities.hpp"
+#include "clock.hpp"
+#include "placement.hpp"
+#include "waitstrategy.hpp"
+
+using namespace std;
+
+// What a full channel does with one more value:
+// OVERFLOW_BLOCK waits for room, OVERFLOW_DROP_OLDEST drops the oldest value, and
+// OVERFLOW_CONFLATE replaces the pending value of the same product, waiting for room only for a new product
+enum OverflowPolicy { OVERFLOW_BLOCK, OVERFLOW_DROP_OLDEST, OVERFLOW_CONFLATE };
+
+/**
+ * Bounded queue of values with an overflow policy, each with the clock time it was pushed at.
+ * Values are delivered in the order they were pushed; a conflated value keeps the place of the one it replaces.
+ * Type V is the value type.
+ */
+template<typename V>
+class BoundedChannel
+{
+
+public:
+
+    // ctor
+    BoundedChannel(size_t _capacity, OverflowPolicy _policy);
+
+    // Push a value of a product, produced at clock time _time; the product only matters when conflating
+    void Push(ProductHandle _key, const V& _data, int64_t _time);
+
+    // Pop the oldest value and its time, false if the channel is empty
+    bool Pop(V& _data, int64_t& _time);
+
+    // Get the number of values held; takes no lock, so a spinning consumer can poll it
+    size_t Size() const { return depth.load(memory_order_acquire); }
+
+    // Get the most values held at once
+    size_t GetHighWater() const { return highWater; }
+
+    // Get the number of values dropped to make room
+    long GetDropped() const { return dropped; }
+
+    // Get the number of pushes that waited for room
+    long GetBlocked() const { return blocked; }
+
+    // Get the number of values replaced before delivery
+    long GetCoalesced() const { return coalesced; }
+
+    size_t GetCapacity() const { return capacity; }
+
+    OverflowPolicy GetPolicy() const { return policy; }
+
+private:
+    size_t capacity;
+    OverflowPolicy policy;
+    mutex lock;
+    condition_variable notFull;
+    int waiting;
+
+    // ring of values, the head at absolute position popped
+    vector<V> slots;
+    vector<int64_t> times;
+    vector<ProductHandle> keys;
+    uint64_t popped;
+    size_t count;
+    ProductMap<uint64_t> pending; // position + 1 of the value pending per product, 0 if none
+
+    atomic<size_t> depth;
+    atomic<size_t> highWater;
+    atomic<long> dropped;
+    atomic<long> blocked;
+    atomic<long> coalesced;
+};
+
+template<typename V>
+BoundedChannel<V>::BoundedChannel(size_t _capacity, OverflowPolicy _policy) :
+    capacity(max(_capacity, size_t(1))), policy(_policy), waiting(0), slots(capacity), times(capacity), popped(0), count(0),
+    depth(0), highWater(0), dropped(0), blocked(0), coalesced(0)
+{
+    if (policy == OVERFLOW_CONFLATE) keys.resize(capacity);
+}
+
+template<typename V>
+void BoundedChannel<V>::Push(ProductHandle _key, const V& _data, int64_t _time)
+{
+    unique_lock<mutex> _guard(lock);
+    if (policy == OVERFLOW_CONFLATE) {
+        uint64_t _pending = pending[_key];
+        if (_pending != 0) {
+            slots[(_pending - 1) % capacity] = _data;
+            times[(_pending - 1) % capacity] = _time;
+            coalesced++;
+            return;
+        }
+    }
+
+    if (count == capacity) {
+        if (policy == OVERFLOW_DROP_OLDEST) {
+            popped++;
+            count--;
+            dropped++;
+        }
+        else {
+            blocked++;
+            waiting++;
+            notFull.wait(_guard, [this]() { return count < capacity; });
+            waiting--;
+        }
+    }
+
+    uint64_t _position = popped + count;
+    slots[_position % capacity] = _data;
+    times[_position % capacity] = _time;
+    if (policy == OVERFLOW_CONFLATE) {
+        keys[_position % capacity] = _key;
+        pending[_key] = _position + 1;
+    }
+    count++;
+    depth.store(count, memory_order_release);
+    if (count > highWater) highWater = count;
+}
+
+template<typename V>
+bool BoundedChannel<V>::Pop(V& _data, int64_t& _time)
+{
+    bool _notify;
+    {
+        lock_guard<mutex> _guard(lock);
+        if (count == 0) return false;
+        size_t _slot = popped % capacity;
+        _data = move(slots[_slot]);
+        _time = times[_slot];
+        if (policy == OVERFLOW_CONFLATE) pending[keys[_slot]] = 0;
+        popped++;
+        count--;
+        depth.store(count, memory_order_release);
+        _notify = waiting > 0;
+    }
+    if (_notify) notFull.notify_one();
+    return true;
+}
+
+/**
+ * Listener handing the values of a Service to a downstream listener on a consumer thread, through a BoundedChannel.
+ * Before Start and after Stop, values go straight to the downstream listener on the calling thread,
+ * so a listener can sit behind a channel and only take a thread of its own while it runs.
+ * A value carries the clock time it was handed over at, which is the event time while it is delivered.
+ * Only add events are handed over. Type V is the data type, which must expose GetProduct().
+ */
+template<typename V>
+class ChannelListener : public ServiceListener<V>
+{
+
+public:
+
+    // ctor
+    ChannelListener(ServiceListener<V>* _downstream, size_t _capacity, OverflowPolicy _policy) :
+        downstream(_downstream), channel(_capacity, _policy), wait(MakeWaitStrategy(WAIT_BLOCKING)), running(false), delivered(0) {}
+    ~ChannelListener() { Stop(); }
+
+    // Set the stage whose placement the consumer thread takes
+    void SetStage(const string& _stage) { stage = _stage; }
+
+    // Set how the consumer thread waits when nothing is pending; blocking by default
+    void SetWaitStrategy(WaitStrategyType _type) { if (!running) wait = MakeWaitStrategy(_type); }
+
+    // Get how the consumer thread waits
+    WaitStrategyType GetWaitStrategy() const { return wait->GetType(); }
+
+    // Start delivering on a dedicated consumer thread
+    void Start();
+
+    // Stop the consumer thread and deliver anything still pending on the caller
+    void Stop();
+
+    // Deliver everything pending on the calling thread, returns the number delivered
+    long Drain();
+
+    // Listener callback to process an add event to the Service
+    void ProcessAdd(V& _data);
+
+    // Listener callback to process a run of add events; handed down as a run while not running
+    void ProcessAddBatch(Span<V> _data);
+
+    // Listener callback to process a remove event to the Service
+    void ProcessRemove(V& /*_data*/) {}
+
+    // Listener callback to process an update event to the Service
+    void ProcessUpdate(V& /*_data*/) {}
+
+    // Get the channel, for its counters
+    const BoundedChannel<V>& GetChannel() const { return channel; }
+
+    // Get the number of values delivered downstream
+    long GetDeliveredCount() const { return delivered; }
+
+    // Whether the consumer thread runs
+    bool IsRunning() const { return running; }
+
+private:
+
+    // Get the product a value is conflated on; only a conflating channel looks it up
+    ProductHandle Key(const V& _data) const {
+        return channel.GetPolicy() == OVERFLOW_CONFLATE ? GetProductHandle(_data.GetProduct().GetProductId()) : 0;
+    }
+
+    ServiceListener<V>* downstream;
+    BoundedChannel<V> channel;
+    string stage;
+    unique_ptr<WaitStrategy> wait;
+    thread worker;
+    atomic<bool> running;
+    atomic<long> delivered;
+};
+
+template<typename V>
+void ChannelListener<V>::Start()
+{
+    if (running) return;
+    running = true;
+    worker = thread([this]() {
+        if (!stage.empty()) PlaceThread(stage);
+        TRACE_THREAD(stage.empty() ? string("channel") : stage);
+        while (running) {
+            if (Drain() == 0) {
+                wait->Wait([this]() { return !running || channel.Size() > 0; });
+            }
+        }
+    });
+}
+
+template<typename V>
+void ChannelListener<V>::Stop()
+{
+    if (running) {
+        running = false;
+        wait->Signal();
+        worker.join();
+    }
+    Drain();
+}
+
+template<typename V>
+long ChannelListener<V>::Drain()
+{
+    long _count = 0;
+    V _data;
+    int64_t _time;
+    while (channel.Pop(_data, _time)) {
+        EventTimeScope _scope(_time);
+        downstream->ProcessAdd(_data);
+        _count++;
+    }
+    delivered += _count;
+    return _count;
+}
+
+template<typename V>
+void ChannelListener<V>::ProcessAdd(V& _data)
+{
+    TRACE_SCOPE("ChannelListener::ProcessAdd");
+    TRACE_PRODUCT(_data.GetProduct());
+    if (!running) {
+        if (channel.Size() > 0) Drain();
+        downstream->ProcessAdd(_data);
+        delivered++;
+        return;
+    }
+    channel.Push(Key(_data), _data, EventTimeNow());
+    wait->Signal();
+}
+
+template<typename V>
+void ChannelListener<V>::ProcessAddBatch(Span<V> _data)
+{
+    TRACE_SCOPE("ChannelListener::ProcessAddBatch");
+    if (!running) {
+        if (channel.Size() > 0) Drain();
+        downstream->ProcessAddBatch(_data);
+        delivered += _data.size();
+        return;
+    }
+    int64_t _time = EventTimeNow();
+    for (V& d : _data) {
+        channel.Push(Key(d), d, _time);
+    }
+    wait->Signal();
+}
+
+#endif
@@ -0,0 +1,133 @@
+/**
+ * clock.hpp
+ * Defines the clock every service reads time from.
+ * The system clock follows the wall clock; a virtual clock is set by a replay
+ * to the event time of the record being replayed, so timestamps and throttles
+ * behave as they did live whatever the replay speed.
+ *
+ * @author Lexie Zhu
+ */
+#ifndef CLOCK_HPP
+#define CLOCK_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+using namespace std;
+
+/**
+ * Source of the current time, in nanoseconds since the epoch.
+ */
+class Clock
+{
+
+public:
+
+    virtual ~Clock() {}
+
+    // Get the current time
+    virtual int64_t Now() const = 0;
+};
+
+/**
+ * Wall clock.
+ */
+class SystemClock : public Clock
+{
+
+public:
+
+    int64_t Now() const override
+    {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+    }
+};
+
+/**
+ * Clock that only moves when it is set; safe to read from any thread.
+ */
+class VirtualClock : public Clock
+{
+
+public:
+
+    // ctor
+    VirtualClock(int64_t _now = 0) : now(_now) {}
+
+    int64_t Now() const override { return now.load(memory_order_acquire); }
+
+    // Move to _now
+    void Set(int64_t _now) { now.store(_now, memory_order_release); }
+
+    // Move forward by _nanoseconds
+    void Advance(int64_t _nanoseconds) { now.fetch_add(_nanoseconds, memory_order_acq_rel); }
+
+private:
+    atomic<int64_t> now;
+};
+
+// the wall clock shared by the whole process
+SystemClock& DefaultClock()
+{
+    static SystemClock systemClock;
+    return systemClock;
+}
+
+// the clock in use, the system clock unless one was injected
+atomic<Clock*>& CurrentClock()
+{
+    static atomic<Clock*> current(&DefaultClock());
+    return current;
+}
+
+// Inject a clock, nullptr goes back to the system clock
+void SetClock(Clock* _clock)
+{
+    CurrentClock().store(_clock ? _clock : &DefaultClock());
+}
+
+// Get the clock in use
+Clock& GetClock()
+{
+    return *CurrentClock().load();
+}
+
+// Get the current time of the clock in use, in nanoseconds since the epoch
+int64_t ClockNow()
+{
+    return GetClock().Now();
+}
+
+// the time of the event the calling thread is handling, 0 outside of one
+int64_t& EventTime()
+{
+    static thread_local int64_t eventTime = 0;
+    return eventTime;
+}
+
+// Get the time of the event being handled, the current time outside of one
+int64_t EventTimeNow()
+{
+    return EventTime() ? EventTime() : ClockNow();
+}
+
+/**
+ * Scope handling an event of a given time on the calling thread,
+ * so a consumer thread stamps what it writes with the time its producer saw.
+ */
+class EventTimeScope
+{
+
+public:
+
+    // ctor
+    EventTimeScope(int64_t _time) : previous(EventTime()) { EventTime() = _time; }
+
+    ~EventTimeScope() { EventTime() = previous; }
+
+private:
+    int64_t previous;
+};
+
+#endif
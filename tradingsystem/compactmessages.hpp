@@ -0,0 +1,171 @@
+/**
+ * compactmessages.hpp
+ * Defines fixed-layout, trivially copyable variants of the service messages.
+ * They carry fixed-width ids, a product handle and prices in ticks,
+ * so they can be memcpy'd through queues, journals and shared memory.
+ * Each message converts itself through ToCompact() and FromCompact().
+ *
+ * @author Lexie Zhu
+ */
+#ifndef COMPACT_MESSAGES_HPP
+#define COMPACT_MESSAGES_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <string_view>
+#include <stdexcept>
+#include <type_traits>
+#include "utilities.hpp"
+
+using namespace std;
+
+const size_t CACHE_LINE_SIZE = 64;
+
+// prices are held in 1/512ths of a point, which keeps 1/256 quotes and their mids exact
+const int PRICE_TICKS_PER_POINT = 512;
+
+int32_t PriceToTicks(double _price) {
+    return static_cast<int32_t>(llround(_price * PRICE_TICKS_PER_POINT));
+}
+
+double TicksToPrice(int32_t _ticks) {
+    return double(_ticks) / PRICE_TICKS_PER_POINT;
+}
+
+/**
+ * Fixed-width, zero-padded identifier.
+ */
+const int COMPACT_ID_WIDTH = 16;
+
+// Check that an id fits a CompactId, throws length_error if it does not; truncated ids could collide
+void CheckCompactId(string_view _id)
+{
+    if (_id.size() > size_t(COMPACT_ID_WIDTH)) {
+        throw length_error("Id " + string(_id) + " is longer than " + to_string(COMPACT_ID_WIDTH) + " characters");
+    }
+}
+
+struct CompactId
+{
+    char value[COMPACT_ID_WIDTH];
+
+    // Set from a string, throws length_error if it is longer than the width
+    void Set(const string& _id) {
+        CheckCompactId(_id);
+        memset(value, 0, COMPACT_ID_WIDTH);
+        memcpy(value, _id.data(), min(_id.size(), size_t(COMPACT_ID_WIDTH)));
+    }
+
+    // Get as a string
+    string Get() const {
+        return string(value, strnlen(value, COMPACT_ID_WIDTH));
+    }
+};
+
+/**
+ * Compact ExecutionOrder, one cache line.
+ */
+struct alignas(CACHE_LINE_SIZE) CompactExecutionOrder
+{
+    CompactId orderId;
+    CompactId parentOrderId;
+    ProductHandle product;
+    int32_t price;
+    int64_t visibleQuantity;
+    int64_t hiddenQuantity;
+    uint8_t side;
+    uint8_t orderType;
+    uint8_t isChildOrder;
+};
+
+/**
+ * Compact Trade, one cache line.
+ */
+const int COMPACT_BOOK_WIDTH = 8;
+
+struct alignas(CACHE_LINE_SIZE) CompactTrade
+{
+    CompactId tradeId;
+    char book[COMPACT_BOOK_WIDTH];
+    ProductHandle product;
+    int32_t price;
+    int64_t quantity;
+    uint8_t side;
+};
+
+/**
+ * Compact Inquiry, one cache line.
+ */
+struct alignas(CACHE_LINE_SIZE) CompactInquiry
+{
+    CompactId inquiryId;
+    ProductHandle product;
+    int32_t price;
+    int64_t quantity;
+    uint8_t side;
+    uint8_t state;
+    int64_t quoteLatency; // receive-to-quote in nanoseconds, -1 if never quoted
+};
+
+/**
+ * Compact PriceStream, one cache line.
+ */
+struct alignas(CACHE_LINE_SIZE) CompactPriceStream
+{
+    ProductHandle product;
+    int32_t bidPrice;
+    int32_t offerPrice;
+    int64_t bidVisibleQuantity;
+    int64_t bidHiddenQuantity;
+    int64_t offerVisibleQuantity;
+    int64_t offerHiddenQuantity;
+};
+
+/**
+ * Compact PV01, half a cache line.
+ */
+struct alignas(CACHE_LINE_SIZE / 2) CompactPV01
+{
+    ProductHandle product;
+    double pv01;
+    int64_t quantity;
+};
+
+/**
+ * Compact Price, a quarter cache line.
+ */
+struct alignas(CACHE_LINE_SIZE / 4) CompactPrice
+{
+    ProductHandle product;
+    int32_t mid;
+    int32_t bidOfferSpread;
+};
+
+/**
+ * Compact OrderBook: this header followed by its bid levels, then its offer levels.
+ */
+struct alignas(CACHE_LINE_SIZE / 4) CompactOrderBook
+{
+    ProductHandle product;
+    uint32_t bids;
+    uint32_t offers;
+};
+
+struct alignas(CACHE_LINE_SIZE / 4) CompactOrder
+{
+    int32_t price;
+    int64_t quantity;
+};
+
+static_assert(is_trivially_copyable<CompactPrice>::value && sizeof(CompactPrice) == CACHE_LINE_SIZE / 4, "CompactPrice layout");
+static_assert(is_trivially_copyable<CompactOrderBook>::value && sizeof(CompactOrderBook) == CACHE_LINE_SIZE / 4, "CompactOrderBook layout");
+static_assert(is_trivially_copyable<CompactOrder>::value && sizeof(CompactOrder) == CACHE_LINE_SIZE / 4, "CompactOrder layout");
+static_assert(is_trivially_copyable<CompactExecutionOrder>::value && sizeof(CompactExecutionOrder) == CACHE_LINE_SIZE, "CompactExecutionOrder layout");
+static_assert(is_trivially_copyable<CompactTrade>::value && sizeof(CompactTrade) == CACHE_LINE_SIZE, "CompactTrade layout");
+static_assert(is_trivially_copyable<CompactInquiry>::value && sizeof(CompactInquiry) == CACHE_LINE_SIZE, "CompactInquiry layout");
+static_assert(is_trivially_copyable<CompactPriceStream>::value && sizeof(CompactPriceStream) == CACHE_LINE_SIZE, "CompactPriceStream layout");
+static_assert(is_trivially_copyable<CompactPV01>::value && sizeof(CompactPV01) == CACHE_LINE_SIZE / 2, "CompactPV01 layout");
+
+#endif
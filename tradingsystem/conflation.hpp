@@ -0,0 +1,40 @@
+/**
+ * conflation.hpp
+ * Defines a conflating hand-off between a Service and a listener that may lag behind it.
+ * Only the most recent value per product is delivered once the consumer falls behind.
+ *
+ * @author Lexie Zhu
+ */
+#ifndef CONFLATION_HPP
+#define CONFLATION_HPP
+
+#include <string>
+#include "soa.hpp"
+#include "channel.hpp"
+
+using namespace std;
+
+// products a conflating channel holds before a new product waits for room
+const size_t CONFLATION_CAPACITY = 65536;
+
+/**
+ * Listener decoupling a Service from a slower downstream listener.
+ * The producing Service only pushes into a channel conflated on product identifier;
+ * a consumer thread delivers the freshest value of each product to the downstream listener.
+ * Type V is the data type, which must expose GetProduct().
+ */
+template<typename V>
+class ConflatingListener : public ChannelListener<V>
+{
+
+public:
+
+    // ctor
+    ConflatingListener(ServiceListener<V>* _downstream, size_t _capacity = CONFLATION_CAPACITY) :
+        ChannelListener<V>(_downstream, _capacity, OVERFLOW_CONFLATE) {}
+
+    // Get the number of snapshots coalesced into a fresher one
+    long GetCoalescedCount() const { return this->GetChannel().GetCoalesced(); }
+};
+
+#endif
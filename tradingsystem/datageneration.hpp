@@ -72,9 +72,11 @@ void GenerateAllPrices() {
     // For testing purposes, we set it to 10000; can change to 1000000 as required
     const int orderSize = 10000;
 
-    for (const auto& [mat, bond] : bondMap) {
-        cout << "Generating prices for security " << bond.first<< " ...\n";
-        GeneratePrice(bond.first, orderSize, file);
+    const ProductRegistry& registry = ProductRegistry::Instance();
+    for (ProductHandle h = 0; h < registry.Size(); h++) {
+        const string& cusip = registry.Get(h).GetProductId();
+        cout << "Generating prices for security " << cusip<< " ...\n";
+        GeneratePrice(cusip, orderSize, file);
     }
 }
 
@@ -128,9 +130,11 @@ void GenerateAllMarketData() {
     // For testing purposes, we set it to 10000; can change to 1000000 as required
     const int orderSize = 10000;
 
-    for (const auto& [mat, bond] : bondMap) {
-        std::cout << "Generating market data for security " << bond.first << " ...\n";
-        GenerateMarketData(bond.first, orderSize, file);
+    const ProductRegistry& registry = ProductRegistry::Instance();
+    for (ProductHandle h = 0; h < registry.Size(); h++) {
+        const string& cusip = registry.Get(h).GetProductId();
+        std::cout << "Generating market data for security " << cusip << " ...\n";
+        GenerateMarketData(cusip, orderSize, file);
     }
 }
 
@@ -157,7 +161,7 @@ void GenerateTradeData(string _id, int _size, ofstream& file) {
         int _market = (int)(d(gen) * 3) % 3 + 1;
         string _book_name = "TRSY" + to_string(_market);
         double _price = 99.0 + mintick * (double)_n;
-        string trading_id = GenerateTradingId(12);
+        string trading_id = "TRD" + GenerateTradingId(9);	// client trade ids never collide with our execution order ids
         file << _id << "," << trading_id << "," << PriceToString(_price) << "," << _book_name << "," << _volume << "," << _string_side << std::endl;
     }
 }
@@ -167,9 +171,11 @@ void GenerateAllTradeData() {
     const string save_path("trades.txt");
     ofstream file(save_path);
     const int tradeSize = 10;
-    for (const auto& [mat, bond] : bondMap) {
-        std::cout << "Generating trades for security " << bond.first << " ...\n";
-        GenerateTradeData(bond.first, tradeSize, file);
+    const ProductRegistry& registry = ProductRegistry::Instance();
+    for (ProductHandle h = 0; h < registry.Size(); h++) {
+        const string& cusip = registry.Get(h).GetProductId();
+        std::cout << "Generating trades for security " << cusip << " ...\n";
+        GenerateTradeData(cusip, tradeSize, file);
     }
 }
 
@@ -198,9 +204,11 @@ void GenerateAllInquiryData() {
     const string save_path("inquiries.txt");
     ofstream file(save_path);
     const int inqSize = 10;
-    for (const auto& [mat, bond] : bondMap) {
-        std::cout << "Generating inquiries for security " << bond.first << " ...\n";
-        GenerateInquiryData(bond.first, inqSize, file);
+    const ProductRegistry& registry = ProductRegistry::Instance();
+    for (ProductHandle h = 0; h < registry.Size(); h++) {
+        const string& cusip = registry.Get(h).GetProductId();
+        std::cout << "Generating inquiries for security " << cusip << " ...\n";
+        GenerateInquiryData(cusip, inqSize, file);
     }
 }
 
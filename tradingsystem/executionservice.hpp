@@ -158,7 +158,7 @@ template<typename T>
 class ExecutionService : public Service<string, ExecutionOrder<T>>
 {
 private:
-    map<string, ExecutionOrder<T>> executionOrders;
+    ProductMap<ExecutionOrder<T>> executionOrders;
     vector<ServiceListener<ExecutionOrder<T>>*> listeners;
     AlgoExecutionToExecutionListener<T>* listener;
 
@@ -166,7 +166,7 @@ public:
 
     // Ctor
     ExecutionService(){
-        executionOrders = map<string, ExecutionOrder<T>>();
+        executionOrders = ProductMap<ExecutionOrder<T>>();
         listeners = vector<ServiceListener<ExecutionOrder<T>>*>();
         listener = new AlgoExecutionToExecutionListener<T>(this);
     }
@@ -178,8 +178,12 @@ public:
 
     // Callback for any new or updated data
     void OnMessage(ExecutionOrder<T>& _data){
+        TRACE_SCOPE("ExecutionService::OnMessage");
+        TRACE_PRODUCT(_data.GetProduct());
+        this->metrics.CountIn();
         string _id = _data.GetProduct().GetProductId();
         executionOrders[_id] = _data;
+        this->metrics.SetStateSize(executionOrders.Size());
     }
 
     // Add a listener to the Service for callbacks on add, remove, and update events for data to the Service
@@ -205,8 +209,10 @@ template<typename T>
 void ExecutionService<T>::ExecuteOrder(ExecutionOrder<T>& _executionOrder)
 {
     executionOrders[_executionOrder.GetProduct().GetProductId()] = _executionOrder;
+    this->metrics.SetStateSize(executionOrders.Size());
 
     // call the listeners
+    FanOutTimer _timer(this->metrics);
     for (auto& l : listeners)
     {
         l->ProcessAdd(_executionOrder);
@@ -249,6 +255,8 @@ private:
 template<typename T>
 void AlgoExecutionToExecutionListener<T>::ProcessAdd(AlgoExecution<T>& _data)
 {
+    TRACE_SCOPE("AlgoExecutionToExecutionListener::ProcessAdd");
+    TRACE_PRODUCT(_data.GetExecutionOrder()->GetProduct());
     // call algo to execute the order
     ExecutionOrder<T>* execution_order = _data.GetExecutionOrder();
 
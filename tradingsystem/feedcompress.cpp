@@ -0,0 +1,34 @@
+/** Compresses a data file into a compressed feed the trading system reads with --feed <name>=file:<file>.z
+* Usage: feedcompress <file> [<compressed file>]
+* The records are cut into frames of about 1MB, each compressed on its own with CompressBlock.
+* Without an output name the feed is written to <file>.z.
+* Compile it like main.cpp: g++ -std=c++17 -O2 feedcompress.cpp -o feedcompress
+* @author: Lexie Zhu
+*/
+#include <iostream>
+#include <fstream>
+#include "bytesource.hpp"
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: feedcompress <file> [<compressed file>]" << std::endl;
+        return 1;
+    }
+    string inPath = argv[1];
+    string outPath = argc > 2 ? argv[2] : inPath + ".z";
+
+    ifstream in(inPath);
+    if (!in) {
+        std::cerr << "Cannot open " << inPath << std::endl;
+        return 1;
+    }
+    ofstream out(outPath, ios::binary | ios::trunc);
+    long records = WriteCompressedFeed(in, out);
+    out.close();
+    if (!out) {
+        std::cerr << "Cannot write " << outPath << std::endl;
+        return 1;
+    }
+    std::cout << records << " records of " << inPath << " written to " << outPath << "." << std::endl;
+    return 0;
+}
@@ -0,0 +1,149 @@
+/**
+ * feedscheduler.hpp
+ * Defines coroutine subscriptions of Connectors and a scheduler interleaving them on one thread.
+ * A subscription parses its byte source a batch of records at a time and suspends after each batch,
+ * so several feeds share the calling thread cooperatively instead of each taking it until EOF.
+ * Coroutines need C++20 (g++ -std=c++20); without them only the blocking Subscribe is available.
+ *
+ * @author Lexie Zhu
+ */
+#ifndef FEED_SCHEDULER_HPP
+#define FEED_SCHEDULER_HPP
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#define FEED_COROUTINES 1
+
+#include <coroutine>
+#include <exception>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "soa.hpp"
+
+using namespace std;
+
+/**
+ * A feed being read by a coroutine. It yields the number of records read since it last yielded.
+ */
+class FeedTask
+{
+
+public:
+
+    struct promise_type
+    {
+        long records = 0;
+        exception_ptr error;
+
+        FeedTask get_return_object() { return FeedTask(coroutine_handle<promise_type>::from_promise(*this)); }
+        suspend_always initial_suspend() noexcept { return {}; }
+        suspend_always final_suspend() noexcept { return {}; }
+        suspend_always yield_value(long _records) { records = _records; return {}; }
+        void return_void() { records = 0; }
+        void unhandled_exception() { error = current_exception(); }
+    };
+
+    FeedTask(FeedTask&& _other) noexcept : handle(_other.handle) { _other.handle = nullptr; }
+    FeedTask(const FeedTask&) = delete;
+    FeedTask& operator=(const FeedTask&) = delete;
+    ~FeedTask() { if (handle) handle.destroy(); }
+
+    // Read the next batch; false once the feed is finished. Rethrows what the feed threw.
+    bool Resume(long& _records);
+
+private:
+    explicit FeedTask(coroutine_handle<promise_type> _handle) : handle(_handle) {}
+
+    coroutine_handle<promise_type> handle;
+};
+
+bool FeedTask::Resume(long& _records)
+{
+    if (!handle || handle.done()) return false;
+    handle.resume();
+    if (handle.promise().error) rethrow_exception(handle.promise().error);
+    _records = handle.promise().records;
+    return !handle.done();
+}
+
+// Subscribe a Connector to a source as a coroutine, suspending after every _batch records
+template<typename V>
+FeedTask SubscribeFeed(Connector<V>* _connector, ByteSource& _source, long _batch)
+{
+    long _count = 0;
+    for (string_view _span; _source.Next(_span); ) {
+        while (!_span.empty()) {
+            string_view _records;
+            _count += TakeRecords(_span, _batch - _count, _records);
+            _connector->ParseRecords(_records);
+            if (_count == _batch) {
+                co_yield _count;
+                _count = 0;
+            }
+        }
+    }
+    _connector->EndOfFeed();
+    co_yield _count;
+}
+
+/**
+ * Runs feed coroutines round robin on the calling thread, one batch of each in turn.
+ */
+class FeedScheduler
+{
+
+public:
+
+    // Add a feed under a name
+    void Add(const string& _name, FeedTask&& _task);
+
+    // Run every feed to its end, returns the number of records read
+    long Run();
+
+    // Get the number of records read from a feed
+    long GetRecords(const string& _name) const;
+
+private:
+
+    struct Feed
+    {
+        string name;
+        FeedTask task;
+        long records;
+    };
+
+    vector<Feed> feeds;
+};
+
+void FeedScheduler::Add(const string& _name, FeedTask&& _task)
+{
+    feeds.push_back(Feed{ _name, move(_task), 0 });
+}
+
+long FeedScheduler::Run()
+{
+    long _total = 0;
+    for (bool _running = true; _running; )
+    {
+        _running = false;
+        for (auto& f : feeds) {
+            long _records = 0;
+            bool _more = f.task.Resume(_records);
+            f.records += _records;
+            _total += _records;
+            _running = _running || _more;
+        }
+    }
+    return _total;
+}
+
+long FeedScheduler::GetRecords(const string& _name) const
+{
+    for (auto& f : feeds) {
+        if (f.name == _name) return f.records;
+    }
+    return 0;
+}
+
+#endif
+#endif
@@ -0,0 +1,121 @@
+/** Publishes a data file to a feed of the trading system, standing in for the exchange.
+* Usage: feedsimulator <endpoint> <file> [<records per second>]
+* The endpoint is one the trading system listens on with --feed: unix:<path>, tcp:[<host>:]<port> or fifo:<path>.
+* It connects, retrying until the trading system listens, streams every line of the file and disconnects,
+* which ends the feed. Without a rate, or with 0, the file is sent as fast as the feed takes it.
+* Compile it like main.cpp: g++ -std=c++17 -O2 feedsimulator.cpp -o feedsimulator
+* @author: Lexie Zhu
+*/
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <csignal>
+#include "reactor.hpp"
+
+#ifdef FEED_REACTOR
+
+// Connect to a feed, retrying for up to _patience; -1 if it never listened
+int Connect(const FeedEndpoint& _endpoint, chrono::seconds _patience)
+{
+    auto _deadline = chrono::steady_clock::now() + _patience;
+    do {
+        int _fd;
+        if (_endpoint.type == ENDPOINT_FIFO) {
+            // the trading system makes the pipe; opening it waits for its reader
+            _fd = open(_endpoint.path.c_str(), O_WRONLY | O_CLOEXEC);
+            if (_fd >= 0) return _fd;
+        }
+        else {
+            sockaddr_storage _address;
+            socklen_t _length = EndpointAddress(_endpoint, _address);
+            _fd = socket(_address.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (_fd < 0) return -1;
+            if (connect(_fd, reinterpret_cast<sockaddr*>(&_address), _length) == 0) return _fd;
+            close(_fd);
+        }
+        this_thread::sleep_for(chrono::milliseconds(100));
+    } while (chrono::steady_clock::now() < _deadline);
+    return -1;
+}
+
+// Write all of a buffer, false if the feed went away
+bool WriteAll(int _fd, const string& _data)
+{
+    for (size_t _written = 0; _written < _data.size(); ) {
+        ssize_t _sent = write(_fd, _data.data() + _written, _data.size() - _written);
+        if (_sent < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        _written += _sent;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "Usage: feedsimulator <endpoint> <file> [<records per second>]" << std::endl;
+        return 1;
+    }
+    // a trading system that stops reading shows up as a failed write
+    signal(SIGPIPE, SIG_IGN);
+
+    FeedEndpoint endpoint;
+    try {
+        endpoint = ParseEndpoint(argv[1]);
+    }
+    catch (const exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    ifstream data(argv[2]);
+    if (!data) {
+        std::cerr << "Cannot open " << argv[2] << std::endl;
+        return 1;
+    }
+    double rate = argc > 3 ? stod(argv[3]) : 0;
+
+    int fd = Connect(endpoint, chrono::seconds(30));
+    if (fd < 0) {
+        std::cerr << SystemError(string("Cannot connect to ") + argv[1]) << std::endl;
+        return 1;
+    }
+
+    // unpaced records go out in large writes; paced ones one at a time
+    const size_t chunk = 65536;
+    string pending;
+    long records = 0;
+    auto start = chrono::steady_clock::now();
+    for (string line; getline(data, line); ) {
+        pending += line;
+        pending += '\n';
+        records++;
+        if (rate > 0) {
+            this_thread::sleep_until(start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(records / rate)));
+        }
+        if (rate > 0 || pending.size() >= chunk) {
+            if (!WriteAll(fd, pending)) break;
+            pending.clear();
+        }
+    }
+    bool sent = WriteAll(fd, pending);
+    close(fd);
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    if (!sent) {
+        std::cerr << SystemError(string("Feed ") + argv[1] + " went away") << std::endl;
+        return 1;
+    }
+    std::cout << records << " records sent to " << argv[1] << " in " << seconds << "s." << std::endl;
+    return 0;
+}
+
+#else
+
+int main(int argc, char* argv[]) {
+    std::cerr << "feedsimulator needs Linux." << std::endl;
+    return 1;
+}
+
+#endif
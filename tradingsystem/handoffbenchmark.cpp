@@ -0,0 +1,89 @@
+/** Measures the market data to algo execution hand-off under each wait strategy.
+* Usage: handoffbenchmark [<order books> [<microseconds between books>]]
+* Order books are handed through a ConflatingListener at a steady pace, the way MarketDataService
+* feeds AlgoExecutionService, and the consumer records how long each one took to arrive.
+* The cpu used while the consumer mostly waits shows what each strategy costs.
+* Compile it like main.cpp: g++ -std=c++17 -O2 handoffbenchmark.cpp -o handoffbenchmark -lpthread
+* @author: Lexie Zhu
+*/
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <sys/resource.h>
+#include "marketdataservice.hpp"
+#include "conflation.hpp"
+#include "utilities.hpp"
+
+// Records the delay between sending and receiving each order book
+class LatencyListener : public ServiceListener<OrderBook<Bond>>
+{
+
+public:
+
+    LatencyListener(const atomic<int64_t>& _sentAt) : sentAt(_sentAt) {}
+
+    void ProcessAdd(OrderBook<Bond>& /*_data*/) override {
+        latencies.push_back(SteadyNow() - sentAt.load(memory_order_acquire));
+    }
+
+    void ProcessRemove(OrderBook<Bond>& /*_data*/) override {}
+
+    void ProcessUpdate(OrderBook<Bond>& /*_data*/) override {}
+
+    static int64_t SteadyNow() {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    vector<int64_t> latencies;
+
+private:
+    const atomic<int64_t>& sentAt;
+};
+
+// Get the cpu time of the process, in nanoseconds
+int64_t ProcessCpuTime()
+{
+    rusage _usage;
+    getrusage(RUSAGE_SELF, &_usage);
+    return (int64_t(_usage.ru_utime.tv_sec + _usage.ru_stime.tv_sec) * 1000000 + _usage.ru_utime.tv_usec + _usage.ru_stime.tv_usec) * 1000;
+}
+
+int main(int argc, char* argv[]) {
+    size_t books = argc > 1 ? stoul(argv[1]) : 20000;
+    int interval = argc > 2 ? stoi(argv[2]) : 50;
+
+    vector<Order> bids{ Order(99.5, 10000000, BID) };
+    vector<Order> offers{ Order(99.6, 10000000, OFFER) };
+    OrderBook<Bond> book(RetrieveProduct(2), bids, offers);
+
+    std::cout << setw(12) << "strategy" << setw(10) << "p50" << setw(10) << "p99" << setw(10) << "max"
+              << "  (us)" << setw(8) << "cpu" << std::endl;
+    for (WaitStrategyType type : { WAIT_BUSY_SPIN, WAIT_SPIN_YIELD, WAIT_BLOCKING, WAIT_BACKOFF })
+    {
+        atomic<int64_t> sentAt(0);
+        LatencyListener downstream(sentAt);
+        downstream.latencies.reserve(books);
+        ConflatingListener<OrderBook<Bond>> link(&downstream);
+        link.SetWaitStrategy(type);
+        link.Start();
+
+        int64_t cpuStart = ProcessCpuTime();
+        auto wallStart = chrono::steady_clock::now();
+        for (size_t i = 0; i < books; i++) {
+            this_thread::sleep_for(chrono::microseconds(interval));
+            sentAt.store(LatencyListener::SteadyNow(), memory_order_release);
+            link.ProcessAdd(book);
+        }
+        link.Stop();
+        double wall = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - wallStart).count();
+        double cpu = double(ProcessCpuTime() - cpuStart) / wall;
+
+        // books coalesced before delivery have no latency of their own
+        vector<int64_t>& l = downstream.latencies;
+        sort(l.begin(), l.end());
+        std::cout << setw(12) << WaitStrategyName(type) << fixed << setprecision(1)
+                  << setw(10) << l[l.size() / 2] / 1000.0 << setw(10) << l[l.size() * 99 / 100] / 1000.0
+                  << setw(10) << l.back() / 1000.0 << "      " << setw(7) << setprecision(0) << cpu * 100 << "%" << std::endl;
+    }
+    return 0;
+}
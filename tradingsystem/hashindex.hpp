@@ -0,0 +1,160 @@
+/**
+ * hashindex.hpp
+ * Defines an open-addressing hash index from string keys to record slots.
+ *
+ * @author Lexie Zhu
+ */
+#ifndef HASH_INDEX_HPP
+#define HASH_INDEX_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+// FNV-1a hash of a key
+uint64_t HashKey(const char* _data, size_t _size)
+{
+    uint64_t _hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < _size; i++) {
+        _hash ^= static_cast<unsigned char>(_data[i]);
+        _hash *= 1099511628211ULL;
+    }
+    return _hash;
+}
+
+/**
+ * Linear-probing hash index mapping a key to a 32-bit slot in some record store.
+ * The table is kept at most half full; erase shifts the probe chain back, so no tombstones are left.
+ */
+class OpenAddressingIndex
+{
+
+public:
+
+    // ctor, capacity is rounded up to a power of two
+    OpenAddressingIndex(size_t _capacity = 16);
+
+    // Insert a key, false if it is already present
+    bool Insert(const string& _key, uint32_t _slot);
+
+    // Find a key, false if absent
+    bool Find(string_view _key, uint32_t& _slot) const;
+
+    // Erase a key, false if absent
+    bool Erase(const string& _key);
+
+    // Get the number of keys held
+    size_t Size() const { return count; }
+
+    // Remove every key
+    void Clear();
+
+private:
+
+    struct Entry
+    {
+        string key;
+        uint64_t hash;
+        uint32_t slot;
+        bool used;
+    };
+
+    // Position holding the key, or the empty position ending its probe chain
+    size_t Probe(string_view _key, uint64_t _hash) const;
+
+    // Double the table
+    void Grow();
+
+    vector<Entry> entries;
+    size_t mask;
+    size_t count;
+};
+
+OpenAddressingIndex::OpenAddressingIndex(size_t _capacity)
+{
+    size_t _size = 16;
+    while (_size < _capacity * 2) _size <<= 1;
+    entries.assign(_size, Entry{ string(), 0, 0, false });
+    mask = _size - 1;
+    count = 0;
+}
+
+size_t OpenAddressingIndex::Probe(string_view _key, uint64_t _hash) const
+{
+    size_t _pos = _hash & mask;
+    while (entries[_pos].used && (entries[_pos].hash != _hash || entries[_pos].key != _key)) {
+        _pos = (_pos + 1) & mask;
+    }
+    return _pos;
+}
+
+bool OpenAddressingIndex::Insert(const string& _key, uint32_t _slot)
+{
+    uint64_t _hash = HashKey(_key.data(), _key.size());
+    size_t _pos = Probe(_key, _hash);
+    if (entries[_pos].used) return false;
+
+    if ((count + 1) * 2 > entries.size()) {
+        Grow();
+        _pos = Probe(_key, _hash);
+    }
+    entries[_pos] = Entry{ _key, _hash, _slot, true };
+    count++;
+    return true;
+}
+
+bool OpenAddressingIndex::Find(string_view _key, uint32_t& _slot) const
+{
+    size_t _pos = Probe(_key, HashKey(_key.data(), _key.size()));
+    if (!entries[_pos].used) return false;
+    _slot = entries[_pos].slot;
+    return true;
+}
+
+bool OpenAddressingIndex::Erase(const string& _key)
+{
+    size_t _pos = Probe(_key, HashKey(_key.data(), _key.size()));
+    if (!entries[_pos].used) return false;
+
+    // shift later members of the chain back into the hole
+    size_t _hole = _pos;
+    size_t _next = (_hole + 1) & mask;
+    while (entries[_next].used) {
+        size_t _home = entries[_next].hash & mask;
+        if (((_next - _home) & mask) >= ((_next - _hole) & mask)) {
+            entries[_hole] = std::move(entries[_next]);
+            _hole = _next;
+        }
+        _next = (_next + 1) & mask;
+    }
+    entries[_hole] = Entry{ string(), 0, 0, false };
+    count--;
+    return true;
+}
+
+void OpenAddressingIndex::Clear()
+{
+    for (auto& e : entries) {
+        e = Entry{ string(), 0, 0, false };
+    }
+    count = 0;
+}
+
+void OpenAddressingIndex::Grow()
+{
+    vector<Entry> _old;
+    _old.swap(entries);
+    entries.assign(_old.size() * 2, Entry{ string(), 0, 0, false });
+    mask = entries.size() - 1;
+    for (auto& e : _old) {
+        if (!e.used) continue;
+        size_t _pos = e.hash & mask;
+        while (entries[_pos].used) _pos = (_pos + 1) & mask;
+        entries[_pos] = std::move(e);
+    }
+}
+
+#endif
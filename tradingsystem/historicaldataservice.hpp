@@ -17,9 +17,31 @@
 #include "executionservice.hpp"
 #include "streamingservice.hpp"
 #include "inquiryservice.hpp"
+#include "historystore.hpp"
+#include "binaryhistory.hpp"
 
 enum ServiceType { POSITION, RISK, EXECUTION, STREAMING, INQUIRY };
 
+// name of the persist step of each service type in a trace
+const char* const HISTORY_TRACE_NAMES[] = { "Persist positions", "Persist risk", "Persist executions", "Persist streaming", "Persist inquiries" };
+
+// text files, or compressed binary files read back with historyexport
+enum HistoryFormat { HISTORY_TEXT, HISTORY_BINARY };
+
+// Get the file the historical data of a service type is persisted to
+string HistoryFileName(ServiceType _type, HistoryFormat _format = HISTORY_TEXT)
+{
+    string _extension = _format == HISTORY_TEXT ? ".txt" : ".hist";
+    switch (_type)
+    {
+    case POSITION: return "positions" + _extension;
+    case RISK: return "risk" + _extension;
+    case EXECUTION: return "executions" + _extension;
+    case STREAMING: return "streaming" + _extension;
+    default: return "allinquiries" + _extension;
+    }
+}
+
 /**
 * Pre-declearations
 */
@@ -35,7 +57,7 @@ class HistoricalDataListener;
  * Type V is the data type to persist (for some services)
  */
 template<typename V>
-class HistoricalDataService : Service<string, V>
+class HistoricalDataService : public Service<string, V>
 {
 
 public:
@@ -43,18 +65,25 @@ public:
     // Ctor
     //default set as inquiry
     HistoricalDataService(){
-        historicalDatas = map<string, V>();
+        historicalDatas = ProductMap<V>();
         listeners = vector<ServiceListener<V>*>();
         connector = new HistoricalDataConnector<V>(this);
         listener = new HistoricalDataListener<V>(this);
         type = INQUIRY;
+        format = HISTORY_TEXT;
     }
     HistoricalDataService(ServiceType _type){
-        historicalDatas = map<string, V>();
+        historicalDatas = ProductMap<V>();
         listeners = vector<ServiceListener<V>*>();
         connector = new HistoricalDataConnector<V>(this);
         listener = new HistoricalDataListener<V>(this);
         type = _type;
+        format = HISTORY_TEXT;
+    }
+
+    // dtor, writes out what is persisted
+    ~HistoricalDataService(){
+        connector->Flush();
     }
 
     // Get data by key
@@ -64,7 +93,11 @@ public:
 
     // Callback for any new or updated data
     void OnMessage(V& _data){
+        TRACE_SCOPE("HistoricalDataService::OnMessage");
+        TRACE_PRODUCT(_data.GetProduct());
+        this->metrics.CountIn();
         historicalDatas[_data.GetProduct().GetProductId()] = _data;
+        this->metrics.SetStateSize(historicalDatas.Size());
     }
 
     // Add a listener to the Service for callbacks on add, remove, and update events for data to the Service
@@ -92,18 +125,35 @@ public:
         return type;
     }
 
+    // Set the storage format, before any data is persisted
+    void SetFormat(HistoryFormat _format){
+        format = _format;
+    }
+
+    // Get the storage format
+    HistoryFormat GetFormat() const{
+        return format;
+    }
+
     // Persist data to a store
     void PersistData(string _persistKey, V& _data){
+        this->metrics.CountIn();
         connector->Publish(_data);
     }
 
+    // Get the persisted records of a product between _from and _to (clock times), inclusive
+    vector<string> Query(const string& _productId, int64_t _from, int64_t _to){
+        return connector->Query(_productId, _from, _to);
+    }
+
 private:
 
-    map<string, V> historicalDatas;
+    ProductMap<V> historicalDatas;
     vector<ServiceListener<V>*> listeners;
     HistoricalDataConnector<V>* connector;
     ServiceListener<V>* listener;
     ServiceType type;
+    HistoryFormat format;
 };
 
 /**
@@ -119,22 +169,44 @@ class HistoricalDataConnector : public Connector<V>
 private:
 
     HistoricalDataService<V>* service;
+    HistoryStore* store;
+
+    // Get the store, opened on first use as the service type is set after the connector is built
+    HistoryStore* GetStore();
 
 public:
 
     // Ctor
     HistoricalDataConnector(HistoricalDataService<V>* _service){
         service = _service;
+        store = nullptr;
+    }
+
+    ~HistoricalDataConnector(){
+        delete store;
     }
 
     // Publish data to the Connector
     void Publish(V& _data);
 
-    // Subscribe data from the Connector (not implemented)
-    void Subscribe(ifstream& _data) {}
+    // Write out what is persisted
+    void Flush();
+
+    // Get the persisted records of a product between _from and _to, inclusive
+    vector<string> Query(const string& _productId, int64_t _from, int64_t _to);
 
 };
 
+template<typename V>
+HistoryStore* HistoricalDataConnector<V>::GetStore()
+{
+    if (store) return store;
+    string _path = HistoryFileName(service->GetServiceType(), service->GetFormat());
+    if (service->GetFormat() == HISTORY_BINARY) store = new BinaryHistoryStore(_path);
+    else store = new TextHistoryStore(_path);
+    return store;
+}
+
 /** Publish is the core function.
  *
  * @tparam V
@@ -143,34 +215,24 @@ public:
 template<typename V>
 void HistoricalDataConnector<V>::Publish(V& _data)
 {
-    ServiceType _type = service->GetServiceType();
-    ofstream _file;
-    if (_type == POSITION) {
-        _file.open("positions.txt", ios::app);
-    }
-    if (_type == RISK) {
-        _file.open("risk.txt", ios::app);
-    }
-    if (_type == EXECUTION) {
-        _file.open("executions.txt", ios::app);
-    }
-    if (_type == STREAMING) {
-        _file.open("streaming.txt", ios::app);
-        //cout << "Start writing." << endl;
-    }
-    if (_type == INQUIRY) {
-        _file.open("allinquiries.txt", ios::app);
-    }
+    TRACE_SCOPE(HISTORY_TRACE_NAMES[service->GetServiceType()]);
+    TRACE_PRODUCT(_data.GetProduct());
+    // Call ToStrings() to write data into files, indexed by product and time.
+    // A writer thread stamps the record with the time it was produced at, not the time it got to it.
+    GetStore()->Append(_data.GetProduct().GetProductId(), EventTimeNow(), _data.ToStrings());
+    this->metrics.CountOut();
+}
 
-    _file << GetTimeStamp() << ",";
+template<typename V>
+void HistoricalDataConnector<V>::Flush()
+{
+    if (store) store->Flush();
+}
 
-    // Call ToStrings() to write data into files.
-    vector<string> _dataStrings = _data.ToStrings();
-    for (auto& s : _dataStrings)
-    {
-        _file << s << ",";
-    }
-    _file << endl;
+template<typename V>
+vector<string> HistoricalDataConnector<V>::Query(const string& _productId, int64_t _from, int64_t _to)
+{
+    return GetStore()->Query(_productId, _from, _to);
 }
 
 /**
@@ -199,6 +261,8 @@ public:
 
     // Listener callback to process an add event to the Service
     void ProcessAdd(V& _data){
+        TRACE_SCOPE("HistoricalDataListener::ProcessAdd");
+        TRACE_PRODUCT(_data.GetProduct());
         string _persistKey = _data.GetProduct().GetProductId();
         service->PersistData(_persistKey, _data);
     }
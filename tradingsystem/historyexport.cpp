@@ -0,0 +1,51 @@
+/** Exports a binary history file (.hist) to the text format of the .txt history files.
+* Usage: historyexport <file.hist> [<productId> "<from>" "<to>"]
+* Times are written as in the history files, e.g. "2023-12-20 09:30:00.000".
+* With a product and time range only the blocks its index points at are decoded.
+* Compile it like main.cpp: g++ -std=c++17 historyexport.cpp -o historyexport
+* @author: Lexie Zhu
+*/
+#include <iostream>
+#include "binaryhistory.hpp"
+
+int main(int argc, char* argv[]) {
+    if (argc != 2 && argc != 5) {
+        std::cerr << "Usage: " << argv[0] << " <file.hist> [<productId> \"<from>\" \"<to>\"]" << std::endl;
+        return 1;
+    }
+
+    try {
+        BinaryHistoryReader reader(argv[1]);
+        if (argc == 2) {
+            // the whole file, in the order it was written
+            vector<HistoryRecord> block;
+            while (reader.NextBlock(block)) {
+                for (auto& r : block) {
+                    std::cout << FormatHistoryLine(r.time, r.fields) << "\n";
+                }
+            }
+            return 0;
+        }
+
+        ProductHandle product;
+        int64_t from = ParseTimeStamp(argv[3]);
+        int64_t to = ParseTimeStamp(argv[4]);
+        if (!FindProductHandle(argv[2], product) || from < 0 || to < 0) {
+            std::cerr << "Unknown product or malformed time" << std::endl;
+            return 1;
+        }
+        HistoryIndex index;
+        if (!index.Load(string(argv[1]) + ".idx")) {
+            std::cerr << "No index " << argv[1] << ".idx" << std::endl;
+            return 1;
+        }
+        for (auto& r : reader.Query(index, product, from, to)) {
+            std::cout << FormatHistoryLine(r.time, r.fields) << "\n";
+        }
+    }
+    catch (const exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,282 @@
+/**
+ * historystore.hpp
+ * Defines the stores behind the historical data files, the text store, and their sparse index.
+ * Records are written in blocks; when a block closes, every product in it gets one index entry
+ * with the block's byte range and the product's first and last record times in the block.
+ * The index is kept in memory and appended to a sidecar file (<file>.idx), so a query for
+ * a product and time range reads only the blocks that can hold matching records.
+ *
+ * @author Lexie Zhu
+ */
+#ifndef HISTORY_STORE_HPP
+#define HISTORY_STORE_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <filesystem>
+#include <type_traits>
+#include <stdexcept>
+#include "utilities.hpp"
+
+using namespace std;
+
+// records per block; a query reads whole blocks
+const long HISTORY_BLOCK_RECORDS = 256;
+
+/**
+ * Index entry: a product has records from firstTime to lastTime in the block at [offset, offset + length).
+ */
+struct HistoryBlockEntry
+{
+    ProductHandle product;
+    uint32_t length;
+    uint64_t offset;
+    int64_t firstTime;
+    int64_t lastTime;
+};
+
+static_assert(is_trivially_copyable<HistoryBlockEntry>::value && sizeof(HistoryBlockEntry) == 32, "HistoryBlockEntry layout");
+
+/**
+ * Sparse index from a product and time range to blocks of a history file.
+ */
+class HistoryIndex
+{
+
+public:
+
+    // Add an entry; entries of a product arrive in time order
+    void Add(const HistoryBlockEntry& _entry);
+
+    // Get the blocks that may hold records of the product between _from and _to, inclusive
+    vector<HistoryBlockEntry> Find(ProductHandle _product, int64_t _from, int64_t _to) const;
+
+    // Load the entries of a sidecar index file, false if there is none
+    bool Load(const string& _path);
+
+    // Remove every entry
+    void Clear() { blocks.Clear(); }
+
+private:
+    ProductMap<vector<HistoryBlockEntry>> blocks;
+};
+
+void HistoryIndex::Add(const HistoryBlockEntry& _entry)
+{
+    blocks[_entry.product].push_back(_entry);
+}
+
+vector<HistoryBlockEntry> HistoryIndex::Find(ProductHandle _product, int64_t _from, int64_t _to) const
+{
+    vector<HistoryBlockEntry> _found;
+    const vector<HistoryBlockEntry>* _held = blocks.Find(_product);
+    if (!_held) return _found;
+
+    // the first block still running at _from, then every block starting by _to
+    const vector<HistoryBlockEntry>& _entries = *_held;
+    auto _first = lower_bound(_entries.begin(), _entries.end(), _from,
+        [](const HistoryBlockEntry& e, int64_t t) { return e.lastTime < t; });
+    for (auto e = _first; e != _entries.end() && e->firstTime <= _to; ++e) {
+        _found.push_back(*e);
+    }
+    return _found;
+}
+
+bool HistoryIndex::Load(const string& _path)
+{
+    ifstream _file(_path, ios::binary);
+    if (!_file) return false;
+    HistoryBlockEntry _entry;
+    while (_file.read(reinterpret_cast<char*>(&_entry), sizeof(_entry))) {
+        Add(_entry);
+    }
+    return true;
+}
+
+/**
+ * Store of historical records, indexed by product and time.
+ * Records are queried back in the text format of the history files.
+ */
+class HistoryStore
+{
+
+public:
+
+    virtual ~HistoryStore() {}
+
+    // Append a record of a product at a clock time
+    virtual void Append(const string& _productId, int64_t _time, const vector<string>& _fields) = 0;
+
+    // Close the open block and write everything out
+    virtual void Flush() = 0;
+
+    // Get the records of a product between _from and _to, inclusive
+    virtual vector<string> Query(const string& _productId, int64_t _from, int64_t _to) = 0;
+};
+
+// Find the handle of a product id, false if it is not a known product
+bool FindProductHandle(const string& _productId, ProductHandle& _product)
+{
+    try {
+        _product = GetProductHandle(_productId);
+        return true;
+    }
+    catch (const out_of_range&) {
+        return false;
+    }
+}
+
+// Format a record as a line of a text history file, without the line break
+string FormatHistoryLine(int64_t _time, const vector<string>& _fields)
+{
+    string _line = FormatTimeStamp(_time) + ",";
+    for (auto& s : _fields) {
+        _line += s;
+        _line += ",";
+    }
+    return _line;
+}
+
+/**
+ * Read the records of a product between _from and _to, inclusive, from a text history file.
+ * Only the blocks the index points at are read. Each record is returned as its line.
+ */
+vector<string> ReadTextHistory(const string& _path, const HistoryIndex& _index, const string& _productId, int64_t _from, int64_t _to)
+{
+    vector<string> _records;
+    ifstream _file(_path, ios::binary);
+    if (!_file) return _records;
+
+    ProductHandle _product;
+    if (!FindProductHandle(_productId, _product)) return _records;
+
+    string _block;
+    for (auto& e : _index.Find(_product, _from, _to))
+    {
+        _block.resize(e.length);
+        _file.seekg(e.offset);
+        _file.read(&_block[0], e.length);
+
+        // a block interleaves products, keep the lines of this one in range
+        size_t _start = 0;
+        while (_start < _block.size())
+        {
+            size_t _end = _block.find('\n', _start);
+            if (_end == string::npos) _end = _block.size();
+            string _line = _block.substr(_start, _end - _start);
+            _start = _end + 1;
+
+            vector<string> _cells = SplitLine(_line);
+            if (_cells.size() < 2) continue;
+            int64_t _time = ParseTimeStamp(_cells[0]);
+            if (_time < _from || _time > _to) continue;
+            if (find(_cells.begin() + 1, _cells.end(), _productId) == _cells.end()) continue;
+            _records.push_back(_line);
+        }
+    }
+    return _records;
+}
+
+/**
+ * Text history file with its sparse index, written as records are persisted.
+ */
+class TextHistoryStore : public HistoryStore
+{
+
+public:
+
+    // ctor, appends to _path and its index at _path.idx
+    TextHistoryStore(const string& _path);
+
+    // dtor, closes the open block
+    ~TextHistoryStore();
+
+    void Append(const string& _productId, int64_t _time, const vector<string>& _fields) override;
+
+    void Flush() override;
+
+    vector<string> Query(const string& _productId, int64_t _from, int64_t _to) override;
+
+    // Get the index
+    const HistoryIndex& GetIndex() const { return index; }
+
+private:
+
+    // Index the open block
+    void CloseBlock();
+
+    string path;
+    ofstream file;
+    ofstream indexFile;
+    HistoryIndex index;
+    uint64_t offset;
+    uint64_t blockStart;
+    long blockRecords;
+    ProductMap<pair<int64_t, int64_t>> blockTimes;
+};
+
+TextHistoryStore::TextHistoryStore(const string& _path) : path(_path)
+{
+    // an index without the file it describes is stale
+    offset = filesystem::exists(path) ? filesystem::file_size(path) : 0;
+    if (offset == 0) {
+        ofstream(path + ".idx", ios::binary | ios::trunc);
+    }
+    index.Load(path + ".idx");
+    file.open(path, ios::binary | ios::app);
+    indexFile.open(path + ".idx", ios::binary | ios::app);
+    blockStart = offset;
+    blockRecords = 0;
+}
+
+TextHistoryStore::~TextHistoryStore()
+{
+    Flush();
+}
+
+void TextHistoryStore::Append(const string& _productId, int64_t _time, const vector<string>& _fields)
+{
+    // times are kept to the millisecond, as written
+    _time = _time / 1000000 * 1000000;
+
+    string _line = FormatHistoryLine(_time, _fields) + "\n";
+    file.write(_line.data(), _line.size());
+    offset += _line.size();
+
+    ProductHandle _product = GetProductHandle(_productId);
+    if (!blockTimes.Find(_product)) blockTimes[_product].first = _time;
+    blockTimes[_product].second = _time;
+    if (++blockRecords == HISTORY_BLOCK_RECORDS) CloseBlock();
+}
+
+void TextHistoryStore::CloseBlock()
+{
+    if (blockRecords == 0) return;
+    for (ProductHandle h : blockTimes.GetHandles())
+    {
+        HistoryBlockEntry _entry = { h, static_cast<uint32_t>(offset - blockStart), blockStart, blockTimes[h].first, blockTimes[h].second };
+        index.Add(_entry);
+        indexFile.write(reinterpret_cast<const char*>(&_entry), sizeof(_entry));
+    }
+    // the file is written out before the index entries pointing into it
+    file.flush();
+    indexFile.flush();
+    blockTimes.Clear();
+    blockStart = offset;
+    blockRecords = 0;
+}
+
+void TextHistoryStore::Flush()
+{
+    CloseBlock();
+}
+
+vector<string> TextHistoryStore::Query(const string& _productId, int64_t _from, int64_t _to)
+{
+    Flush();
+    return ReadTextHistory(path, index, _productId, _from, _to);
+}
+
+#endif
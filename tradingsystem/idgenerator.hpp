@@ -0,0 +1,173 @@
+/**
+ * idgenerator.hpp
+ * Defines the generator for order, trade and inquiry identifiers.
+ * Ids are fixed width: a process shard prefix, a thread slot and a per-thread counter,
+ * all in base 36 with digits before letters so that ids sort in generation order.
+ *
+ * @author Lexie Zhu
+ */
+#ifndef ID_GENERATOR_HPP
+#define ID_GENERATOR_HPP
+
+#include <string>
+#include <string_view>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+
+using namespace std;
+
+const int ID_SHARD_WIDTH = 2;
+const int ID_THREAD_WIDTH = 2;
+const int ID_DEFAULT_WIDTH = 12;
+
+// prefixes put before a generated id to make client trade and inquiry ids (see datageneration.hpp)
+const char* const ID_CLIENT_PREFIXES[] = { "TRD", "INQ" };
+
+/**
+ * Lock-free, allocation-free id generator.
+ * Processes started with distinct shard prefixes and threads within a process
+ * never share a prefix, so ids cannot collide.
+ */
+class IdGenerator
+{
+
+public:
+
+    // Set the shard prefix of this process, before any id is generated
+    static void SetShard(const string& _shard);
+
+    // Write the next id of _width characters into _out (not null-terminated)
+    static void Next(char* _out, int _width = ID_DEFAULT_WIDTH);
+
+    // Get the next id as a string; ids up to 15 characters stay in the small string buffer
+    static string Next(int _width = ID_DEFAULT_WIDTH);
+
+    // Move the counter of every thread past that of an id of this shard, such as one restored from a snapshot,
+    // so it is not generated again. A client id is reserved through the generated id after its prefix.
+    // Ids of other shards are ignored: their prefix differs, so they never collide with ours whatever their counter.
+    static void Reserve(string_view _id);
+
+private:
+
+    // Write _value as _width base 36 digits, false if it does not fit
+    static bool Encode(uint64_t _value, char* _out, int _width);
+
+    // Slot of the calling thread, assigned on first use
+    static unsigned ThreadSlot();
+
+    static char* Shard();
+    static atomic<unsigned>& NextSlot();
+
+    // Lowest counter any thread may use next
+    static atomic<uint64_t>& Floor();
+
+    // Reserve an id as generated, without a client prefix
+    static void ReserveGenerated(string_view _id);
+};
+
+static const char ID_DIGITS[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+char* IdGenerator::Shard()
+{
+    // defaults to $TRADING_ID_SHARD, else "00"
+    struct ShardPrefix
+    {
+        char value[ID_SHARD_WIDTH];
+        ShardPrefix() {
+            const char* _env = getenv("TRADING_ID_SHARD");
+            for (int i = 0; i < ID_SHARD_WIDTH; i++) {
+                value[i] = (_env && (int)strlen(_env) > i) ? _env[i] : '0';
+            }
+        }
+    };
+    static ShardPrefix prefix;
+    return prefix.value;
+}
+
+atomic<unsigned>& IdGenerator::NextSlot()
+{
+    static atomic<unsigned> slot(0);
+    return slot;
+}
+
+atomic<uint64_t>& IdGenerator::Floor()
+{
+    static atomic<uint64_t> floor(0);
+    return floor;
+}
+
+void IdGenerator::SetShard(const string& _shard)
+{
+    char* _prefix = Shard();
+    for (int i = 0; i < ID_SHARD_WIDTH; i++) {
+        _prefix[i] = i < (int)_shard.size() ? _shard[i] : '0';
+    }
+}
+
+unsigned IdGenerator::ThreadSlot()
+{
+    thread_local unsigned slot = NextSlot().fetch_add(1);
+    return slot;
+}
+
+bool IdGenerator::Encode(uint64_t _value, char* _out, int _width)
+{
+    for (int i = _width - 1; i >= 0; i--) {
+        _out[i] = ID_DIGITS[_value % 36];
+        _value /= 36;
+    }
+    return _value == 0;
+}
+
+void IdGenerator::Next(char* _out, int _width)
+{
+    thread_local uint64_t counter = 0;
+    uint64_t _floor = Floor().load(memory_order_relaxed);
+    if (counter < _floor) counter = _floor;
+
+    const char* _prefix = Shard();
+    for (int i = 0; i < ID_SHARD_WIDTH; i++) {
+        _out[i] = _prefix[i];
+    }
+    if (!Encode(ThreadSlot(), _out + ID_SHARD_WIDTH, ID_THREAD_WIDTH)) {
+        throw overflow_error("IdGenerator: too many threads");
+    }
+    if (!Encode(counter++, _out + ID_SHARD_WIDTH + ID_THREAD_WIDTH, _width - ID_SHARD_WIDTH - ID_THREAD_WIDTH)) {
+        throw overflow_error("IdGenerator: id width exhausted");
+    }
+}
+
+void IdGenerator::Reserve(string_view _id)
+{
+    ReserveGenerated(_id);
+    for (const char* _client : ID_CLIENT_PREFIXES) {
+        size_t _length = strlen(_client);
+        if (_id.compare(0, _length, _client) == 0) ReserveGenerated(_id.substr(_length));
+    }
+}
+
+void IdGenerator::ReserveGenerated(string_view _id)
+{
+    const int _prefix = ID_SHARD_WIDTH + ID_THREAD_WIDTH;
+    if ((int)_id.size() <= _prefix || _id.compare(0, ID_SHARD_WIDTH, string_view(Shard(), ID_SHARD_WIDTH)) != 0) return;
+    uint64_t _counter = 0;
+    for (size_t i = _prefix; i < _id.size(); i++) {
+        const char* _digit = strchr(ID_DIGITS, _id[i]);
+        if (!_digit || !*_digit || _counter > UINT64_MAX / 36) return;
+        _counter = _counter * 36 + uint64_t(_digit - ID_DIGITS);
+    }
+    uint64_t _floor = Floor().load(memory_order_relaxed);
+    while (_floor <= _counter && !Floor().compare_exchange_weak(_floor, _counter + 1, memory_order_relaxed)) {}
+}
+
+string IdGenerator::Next(int _width)
+{
+    string _id(_width, '0');
+    Next(&_id[0], _width);
+    return _id;
+}
+
+#endif
@@ -7,8 +7,17 @@
 #ifndef INQUIRY_SERVICE_HPP
 #define INQUIRY_SERVICE_HPP
 
+#include <map>
+#include <stdexcept>
+#include <deque>
 #include "soa.hpp"
+#include "compactmessages.hpp"
+#include "journal.hpp"
+#include "archive.hpp"
+#include "hashindex.hpp"
+#include "snapshot.hpp"
 #include "tradebookingservice.hpp"
+#include "pricingservice.hpp"
 #include "utilities.hpp"
 
 // Various inqyury states
@@ -55,6 +64,10 @@ public:
     // Store attributes as strings
     vector<string> ToStrings() const;
 
+    // Convert to and from the fixed layout
+    CompactInquiry ToCompact() const;
+    static Inquiry<T> FromCompact(const CompactInquiry& _compact);
+
 private:
     string inquiryId;
     T product;
@@ -151,15 +164,48 @@ vector<string> Inquiry<T>::ToStrings() const
     return inquiryDetails;
 }
 
+template<typename T>
+CompactInquiry Inquiry<T>::ToCompact() const
+{
+    CompactInquiry _compact;
+    memset(&_compact, 0, sizeof(_compact));
+    _compact.inquiryId.Set(inquiryId);
+    _compact.product = GetProductHandle(product.GetProductId());
+    _compact.price = PriceToTicks(price);
+    _compact.quantity = quantity;
+    _compact.quoteLatency = -1;
+    _compact.side = static_cast<uint8_t>(side);
+    _compact.state = static_cast<uint8_t>(state);
+    return _compact;
+}
+
+template<typename T>
+Inquiry<T> Inquiry<T>::FromCompact(const CompactInquiry& _compact)
+{
+    return Inquiry<T>(_compact.inquiryId.Get(), RetrieveProductByHandle(_compact.product), static_cast<Side>(_compact.side),
+                      _compact.quantity, TicksToPrice(_compact.price), static_cast<InquiryState>(_compact.state));
+}
+
 /**
 * Pre-declearations.
 */
 template<typename T>
 class InquiryConnector;
+template<typename T>
+class InquiryToPricingListener;
+
+// inquiries quoted per pass of the state machine
+const size_t INQUIRY_BATCH_SIZE = 64;
+// inquiries in a terminal state kept live before they are archived
+const size_t INQUIRY_HOT_CAPACITY = 256;
 
 /**
  * Service for customer inquirry objects.
  * Keyed on inquiry identifier (NOTE: this is NOT a product identifier since each inquiry must be unique).
+ * Inquiries move RECEIVED -> QUOTED -> DONE through an explicit state machine:
+ * received inquiries are queued and quoted in batches off the latest PricingService mid,
+ * a batch once it is full or once the records read so far are exhausted.
+ * Inquiries in a terminal state beyond the retention policy move to a compact archive.
  * Type T is the product type.
  */
 template<typename T>
@@ -167,22 +213,73 @@ class InquiryService : public Service<string, Inquiry <T> >
 {
 private:
 
-    map<string, Inquiry<T>> inquiries;
+    vector<Inquiry<T>> inquiries;
+    vector<long long> quoteLatencies; // by slot, -1 if not quoted
+    OpenAddressingIndex inquiryIndex;
+    vector<uint32_t> freeSlots;
     vector<ServiceListener<Inquiry<T>>*> listeners;
     InquiryConnector<T>* connector;
+    InquiryToPricingListener<T>* pricingListener;
+
+    // state machine
+    vector<pair<string, int64_t>> pending; // ids and their receipt time on the clock in use
+    size_t batchSize;
+    ProductMap<double> mids;
+
+    // retention
+    deque<string> terminalIds;
+    RecordArchive<CompactInquiry> archive;
+    RetentionPolicy retention;
+    map<string, Inquiry<T>> recalled; // archived inquiries handed out by GetData, one per id
+
+    // Record that an inquiry reached a terminal state
+    void Retire(const string& _inquiryId);
+
+    // Archive the oldest terminal inquiries beyond the hot capacity
+    void Retain();
+
+    // Hand an inquiry to the listeners
+    void Notify(Inquiry<T>& _inquiry);
+
+    // Hold an inquiry live, replacing any held under its id, and get its slot
+    uint32_t Store(const Inquiry<T>& _inquiry);
+
+    // Get the live inquiry held under an id, throws out_of_range if it is not live
+    Inquiry<T>& Live(const string& _inquiryId){
+        uint32_t _slot;
+        if (!inquiryIndex.Find(_inquiryId, _slot)) throw out_of_range("Inquiry " + _inquiryId + " is not live");
+        return inquiries[_slot];
+    }
+
+    // Get the compact form of the live inquiry in a slot, with its quote latency
+    CompactInquiry ToCompact(uint32_t _slot) const{
+        CompactInquiry _compact = inquiries[_slot].ToCompact();
+        _compact.quoteLatency = quoteLatencies[_slot];
+        return _compact;
+    }
 
 public:
 
     // Ctor
     InquiryService(){
-        inquiries = map<string, Inquiry<T>>();
+        inquiries = vector<Inquiry<T>>();
         listeners = vector<ServiceListener<Inquiry<T>>*>();
         connector = new InquiryConnector<T>(this);
+        pricingListener = new InquiryToPricingListener<T>(this);
+        batchSize = INQUIRY_BATCH_SIZE;
+        retention = RetentionPolicy{ INQUIRY_HOT_CAPACITY };
     }
 
-    // Get data by key
+    // Get data by key, from the live inquiries or else the archive, throws out_of_range for an unknown id
     Inquiry<T>& GetData(string _key){
-        return inquiries[_key];
+        uint32_t _slot;
+        if (inquiryIndex.Find(_key, _slot)) return inquiries[_slot];
+
+        auto _it = recalled.find(_key);
+        if (_it != recalled.end()) return _it->second;
+        CompactInquiry _compact;
+        if (!archive.Find(_key, _compact)) throw out_of_range("Inquiry " + _key + " is not held");
+        return recalled.emplace(_key, Inquiry<T>::FromCompact(_compact)).first->second;
     }
 
     // Callback for any new or updated data
@@ -203,50 +300,254 @@ public:
         return connector;
     }
 
+    // Get the listener feeding mids from the PricingService
+    ServiceListener<Price<T>>* GetPricingListener(){
+        return pricingListener;
+    }
+
+    // Set the number of inquiries quoted per pass
+    void SetBatchSize(size_t _batchSize){
+        batchSize = _batchSize;
+    }
+
+    // Record the latest mid of a product
+    void UpdateMid(const string& _productId, double _mid){
+        mids[_productId] = _mid;
+    }
+
+    // Quote and complete every pending inquiry
+    void ProcessPendingInquiries();
+
+    // Get the receive-to-quote latency of an inquiry, live or archived, in nanoseconds, -1 if not quoted
+    long long GetQuoteLatency(const string& _inquiryId) const{
+        uint32_t _slot;
+        if (inquiryIndex.Find(_inquiryId, _slot)) return quoteLatencies[_slot];
+
+        CompactInquiry _compact;
+        return archive.Find(_inquiryId, _compact) ? _compact.quoteLatency : -1;
+    }
+
     // Issue a price quote in response to a client's inquiry
     void SendQuote(const string& inquiryId, double price){
-        Inquiry<T>& inquiry = inquiries[inquiryId];
+        Inquiry<T>& inquiry = Live(inquiryId);
 
-        // Set the new price for the inquiry and notify all listeners
+        // Set the new price, move to QUOTED and send the quote back to the client
         inquiry.SetPrice(price);
-        for (auto& listener : listeners) {
-            listener->ProcessAdd(inquiry);
-        }
+        inquiry.SetState(QUOTED);
+        connector->Publish(inquiry);
     }
 
     // Reject an inquiry from the client
     void RejectInquiry(const string& _inquiryId){
-        Inquiry<T>& _inquiry = inquiries[_inquiryId];
+        Inquiry<T>& _inquiry = Live(_inquiryId);
 
         // set the state as rejected.
         _inquiry.SetState(REJECTED);
+        Retire(_inquiryId);
     }
+
+    // Set how many terminal inquiries stay live
+    void SetRetention(const RetentionPolicy& _retention){
+        retention = _retention;
+        Retain();
+    }
+
+    // Get the number of live inquiries
+    size_t GetLiveCount() const{
+        return inquiryIndex.Size();
+    }
+
+    // Get the archive of terminal inquiries
+    const RecordArchive<CompactInquiry>& GetArchive() const{
+        return archive;
+    }
+
+    // Save the inquiry state to a snapshot
+    void SaveSnapshot(SnapshotWriter& _writer);
+
+    // Restore the inquiry state from a snapshot
+    void LoadSnapshot(SnapshotReader& _reader);
 };
 
-/** Handles inquiries in RECEIVED and QUOTED states
+template<typename T>
+void InquiryService<T>::SaveSnapshot(SnapshotWriter& _writer)
+{
+    vector<CompactInquiry> _live;
+    for (uint32_t i = 0; i < inquiries.size(); i++) {
+        uint32_t _slot;
+        if (inquiryIndex.Find(inquiries[i].GetInquiryId(), _slot) && _slot == i) {
+            _live.push_back(ToCompact(i));
+        }
+    }
+    _writer.BeginSection("INQY");
+    _writer.WriteVector(_live);
+    _writer.Write(static_cast<uint64_t>(terminalIds.size()));
+    for (auto& _id : terminalIds) {
+        _writer.WriteString(_id);
+    }
+    _writer.WriteVector(archive.GetRecords());
+    _writer.Write(static_cast<uint64_t>(mids.Size()));
+    for (ProductHandle h : mids.GetHandles()) {
+        _writer.Write(h);
+        _writer.Write(mids[h]);
+    }
+}
+
+template<typename T>
+void InquiryService<T>::LoadSnapshot(SnapshotReader& _reader)
+{
+    _reader.BeginSection("INQY");
+    inquiries.clear();
+    quoteLatencies.clear();
+    inquiryIndex.Clear();
+    freeSlots.clear();
+    pending.clear();
+    terminalIds.clear();
+    archive = RecordArchive<CompactInquiry>();
+    recalled.clear();
+    mids.Clear();
+
+    // inquiries still RECEIVED go back on the queue to be quoted
+    for (auto& c : _reader.ReadVector<CompactInquiry>()) {
+        Inquiry<T> _inquiry = Inquiry<T>::FromCompact(c);
+        IdGenerator::Reserve(_inquiry.GetInquiryId());
+        quoteLatencies[Store(_inquiry)] = c.quoteLatency;
+        if (_inquiry.GetState() == RECEIVED) {
+            pending.emplace_back(_inquiry.GetInquiryId(), ClockNow());
+        }
+    }
+    uint64_t _terminal = _reader.Read<uint64_t>();
+    for (uint64_t i = 0; i < _terminal; i++) {
+        terminalIds.push_back(_reader.ReadString());
+        IdGenerator::Reserve(terminalIds.back());
+    }
+    for (auto& c : _reader.ReadVector<CompactInquiry>()) {
+        IdGenerator::Reserve(c.inquiryId.Get());
+        archive.Append(c.inquiryId.Get(), c);
+    }
+    uint64_t _mids = _reader.Read<uint64_t>();
+    for (uint64_t i = 0; i < _mids; i++) {
+        ProductHandle _handle = _reader.Read<ProductHandle>();
+        mids[_handle] = _reader.Read<double>();
+    }
+    this->metrics.SetStateSize(inquiryIndex.Size());
+}
+
+template<typename T>
+uint32_t InquiryService<T>::Store(const Inquiry<T>& _inquiry)
+{
+    uint32_t _slot;
+    if (inquiryIndex.Find(_inquiry.GetInquiryId(), _slot)) {
+        inquiries[_slot] = _inquiry;
+        return _slot;
+    }
+    if (freeSlots.empty()) {
+        _slot = static_cast<uint32_t>(inquiries.size());
+        inquiries.push_back(_inquiry);
+        quoteLatencies.push_back(-1);
+    }
+    else {
+        _slot = freeSlots.back();
+        freeSlots.pop_back();
+        inquiries[_slot] = _inquiry;
+        quoteLatencies[_slot] = -1;
+    }
+    inquiryIndex.Insert(_inquiry.GetInquiryId(), _slot);
+    return _slot;
+}
+
+template<typename T>
+void InquiryService<T>::Retire(const string& _inquiryId)
+{
+    terminalIds.push_back(_inquiryId);
+    Retain();
+}
+
+template<typename T>
+void InquiryService<T>::Retain()
+{
+    while (terminalIds.size() > retention.hotCapacity) {
+        string _id = terminalIds.front();
+        terminalIds.pop_front();
+        uint32_t _slot;
+        if (!inquiryIndex.Find(_id, _slot)) continue;
+        // the quote latency goes with the inquiry into the archive
+        archive.Append(_id, ToCompact(_slot));
+        inquiryIndex.Erase(_id);
+        freeSlots.push_back(_slot);
+    }
+    this->metrics.SetStateSize(inquiryIndex.Size());
+}
+
+template<typename T>
+void InquiryService<T>::Notify(Inquiry<T>& _inquiry)
+{
+    FanOutTimer _timer(this->metrics);
+    for (auto& listener : listeners) {
+        listener->ProcessAdd(_inquiry);
+    }
+}
+
+/** Queues RECEIVED inquiries for quoting, completes QUOTED ones
 * and provides updates to the registered listeners
 */
 template<typename T>
 void InquiryService<T>::OnMessage(Inquiry<T>& inquiry)
 {
-    InquiryState currentState = inquiry.GetState();
-
-    // Handling inquiry in the RECEIVED state
-    if (currentState == RECEIVED) {
-        inquiries[inquiry.GetInquiryId()] = inquiry;
-        connector->Publish(inquiry);
+    TRACE_SCOPE("InquiryService::OnMessage");
+    TRACE_PRODUCT(inquiry.GetProduct());
+    this->metrics.CountIn();
+    string _id = inquiry.GetInquiryId();
+    // a retired inquiry, or a second RECEIVED for one we already hold, is a duplicate
+    uint32_t _slot;
+    if (archive.Contains(_id) || (inquiry.GetState() == RECEIVED && inquiryIndex.Find(_id, _slot))) {
+        this->metrics.CountDropped();
+        return;
     }
+    _slot = Store(inquiry);
+    this->metrics.SetStateSize(inquiryIndex.Size());
+
+    switch (inquiry.GetState()) {
+        case RECEIVED:
+            pending.emplace_back(_id, ClockNow());
+            if (pending.size() >= batchSize) {
+                ProcessPendingInquiries();
+            }
+            break;
+        case QUOTED:
+            // the client accepted our quote
+            inquiries[_slot].SetState(DONE);
+            Notify(inquiries[_slot]);
+            Retire(_id);
+            break;
+        default:
+            Notify(inquiries[_slot]);
+            Retire(_id);
+            break;
+    }
+}
 
-    // Transitioning from QUOTED to DONE state
-    if (currentState == QUOTED) {
-        inquiry.SetState(DONE);
-        inquiries[inquiry.GetInquiryId()] = inquiry;
-
-        // Notifying all listeners about the inquiry update
-        for (auto& listener : listeners) {
-            listener->ProcessAdd(inquiry);
-        }
+// One pass of the state machine over the pending batch
+template<typename T>
+void InquiryService<T>::ProcessPendingInquiries()
+{
+    for (auto& p : pending) {
+        uint32_t _slot;
+        if (!inquiryIndex.Find(p.first, _slot)) continue;
+        Inquiry<T>& _inquiry = inquiries[_slot];
+        if (_inquiry.GetState() != RECEIVED) continue;
+
+        // RECEIVED -> QUOTED, priced off the latest mid when there is one
+        const double* _mid = mids.Find(_inquiry.GetProduct().GetProductId());
+        SendQuote(p.first, _mid ? *_mid : _inquiry.GetPrice());
+        quoteLatencies[_slot] = ClockNow() - p.second;
+
+        // QUOTED -> DONE, the client accepts
+        _inquiry.SetState(DONE);
+        Notify(_inquiry);
+        Retire(p.first);
     }
+    pending.clear();
 }
 
 /**
@@ -266,63 +567,129 @@ public:
     // Ctor
     InquiryConnector(InquiryService<T>* _service){
         service = _service;
+        journal = nullptr;
     }
 
-    // Publish data to the Connector
-    void Publish(Inquiry<T>& _data){
-        if (_data.GetState() == RECEIVED)
-        {
-            _data.SetState(QUOTED);
-            this->Subscribe(_data);
-        }
-    }
+    // Publish a quote back to the client (the file feed has no client side)
+    void Publish(Inquiry<T>& /*_data*/) { this->metrics.CountOut(); }
 
-    // Subscribe data from the Connector
-    void Subscribe(ifstream& _data);
+    // Flow every inquiry record of a span into the Service
+    long ParseRecords(string_view _span);
 
-    // After updating status, Re-subscribe data from the Connector
-    void Subscribe(Inquiry<T>& _data){
-        service->OnMessage(_data);
-    }
+    // Quote whatever is left of the last batch
+    void EndOfFeed();
+
+    // Journal every accepted inquiry, nullptr to stop
+    void SetJournal(Journal* _journal) { journal = _journal; }
+
+private:
+    // Flow one inquiry record, split into cells, into the Service
+    void ProcessRecord();
+
+    Journal* journal;
+    vector<string_view> cells;
 
 };
 
 // core function here
 // read the inquiries.
 template<typename T>
-void InquiryConnector<T>::Subscribe(ifstream& _data)
+long InquiryConnector<T>::ParseRecords(string_view _span)
 {
-    string _line;
-    while (getline(_data, _line))
-    {
-        auto _cells = SplitLine(_line);
-
-        string _inquiryId = _cells[0];
-        string _productId = _cells[1];
-        Side _side = _cells[2] == "BUY" ? BUY : SELL;
-        long _quantity = stol(_cells[3]);
-        double _price = ConvertStringToPrice(_cells[4]);
-        InquiryState _state;
-        if (_cells[5] == "RECEIVED"){
-            _state = RECEIVED;
-        }
-        else if (_cells[5] == "QUOTED") {
-            _state = QUOTED;
-        }
-        else if (_cells[5] == "DONE") {
-            _state = DONE;
+    long _count = 0;
+    for (string_view _record; NextRecord(_span, _record, cells); ) {
+        try {
+            ProcessRecord();
+            _count++;
         }
-        else if (_cells[5] == "REJECTED") {
-            _state = REJECTED;
-        }
-        else if (_cells[5] == "CUSTOMER_REJECTED") {
-            _state = CUSTOMER_REJECTED;
+        catch (const exception& e) {
+            this->Reject(_record, e);
         }
+    }
+
+    // nothing more to read, so nothing waits for a batch to fill
+    service->ProcessPendingInquiries();
+    this->metrics.CountIn(_count);
+    return _count;
+}
 
-        T _product = RetrieveProduct(_productId);
-        Inquiry<T> _inquiry(_inquiryId, _product, _side, _quantity, _price, _state);
-        service->OnMessage(_inquiry);
+template<typename T>
+void InquiryConnector<T>::ProcessRecord()
+{
+    TRACE_SCOPE("InquiryConnector::ParseRecord");
+    const vector<string_view>& _cells = cells;
+    if (_cells.size() < 6) throw invalid_argument("Malformed inquiry record");
+
+    string _inquiryId(_cells[0]);
+    CheckCompactId(_inquiryId);
+    string_view _productId = _cells[1];
+    Side _side = _cells[2] == "BUY" ? BUY : SELL;
+    long _quantity = ParseLong(_cells[3]);
+    double _price = ConvertStringToPrice(_cells[4]);
+    InquiryState _state;
+    if (_cells[5] == "RECEIVED"){
+        _state = RECEIVED;
+    }
+    else if (_cells[5] == "QUOTED") {
+        _state = QUOTED;
+    }
+    else if (_cells[5] == "DONE") {
+        _state = DONE;
+    }
+    else if (_cells[5] == "REJECTED") {
+        _state = REJECTED;
     }
+    else if (_cells[5] == "CUSTOMER_REJECTED") {
+        _state = CUSTOMER_REJECTED;
+    }
+    else {
+        throw invalid_argument("Unknown inquiry state");
+    }
+
+    T _product = RetrieveProduct(_productId);
+    TRACE_PRODUCT(_product);
+    Inquiry<T> _inquiry(_inquiryId, _product, _side, _quantity, _price, _state);
+    if (journal) journal->Append(JOURNAL_INQUIRY, _inquiry.ToCompact());
+    service->OnMessage(_inquiry);
 }
 
+template<typename T>
+void InquiryConnector<T>::EndOfFeed()
+{
+    service->ProcessPendingInquiries();
+}
+
+/**
+* Inquiry Service Listener keeping the latest mid per product from the Pricing Service.
+*/
+template<typename T>
+class InquiryToPricingListener : public ServiceListener<Price<T>>
+{
+
+private:
+
+    InquiryService<T>* service;
+
+public:
+
+    // Ctor
+    InquiryToPricingListener(InquiryService<T>* _service){
+        service = _service;
+    }
+
+    // Process an add event to the Service
+    void ProcessAdd(Price<T>& _data){
+        TRACE_SCOPE("InquiryToPricingListener::ProcessAdd");
+        TRACE_PRODUCT(_data.GetProduct());
+        service->UpdateMid(_data.GetProduct().GetProductId(), _data.GetMid());
+    }
+
+    // Process a remove event to the Service
+    void ProcessRemove(Price<T>& /*_data*/) {}
+
+    // Process an update event to the Service
+    void ProcessUpdate(Price<T>& /*_data*/) {}
+
+};
+
 #endif
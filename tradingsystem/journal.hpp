@@ -0,0 +1,230 @@
+/**
+ * journal.hpp
+ * Defines the write-ahead journal of inbound messages and its reader.
+ * Connectors append every message they accept before handing it to their service,
+ * so the journal is a complete, ordered record of what drove the services.
+ * A record is a fixed header followed by the compact layout of the message.
+ * Records are durable once Flush() returns: the file is synced to the disk, where the system allows it.
+ *
+ * @author Lexie Zhu
+ */
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <type_traits>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <unistd.h>
+#define JOURNAL_FSYNC 1
+#endif
+#include "clock.hpp"
+
+using namespace std;
+
+const uint32_t JOURNAL_MAGIC = 0x4C4E524A; // "JRNL"
+const uint32_t JOURNAL_VERSION = 1;
+
+// the buffer is written out once it holds this many bytes
+const size_t JOURNAL_FLUSH_BYTES = 1 << 16;
+
+// JOURNAL_ALGO_ORDER_BOOK records the books actually handed to algo execution past the conflating link,
+// the one step whose outcome depends on timing rather than on the inbound messages
+enum JournalRecordType : uint16_t { JOURNAL_PRICE = 1, JOURNAL_ORDER_BOOK, JOURNAL_TRADE, JOURNAL_INQUIRY, JOURNAL_ALGO_ORDER_BOOK };
+
+/**
+ * Header of a journal record.
+ * Sequence numbers start at 1 and increase by one per record; timestamp is the event time, in nanoseconds since the epoch.
+ */
+struct JournalRecordHeader
+{
+    uint64_t sequence;
+    int64_t timestamp;
+    uint16_t type;
+    uint16_t reserved;
+    uint32_t length;
+};
+
+static_assert(is_trivially_copyable<JournalRecordHeader>::value && sizeof(JournalRecordHeader) == 24, "JournalRecordHeader layout");
+
+/**
+ * Reader of a journal, record by record.
+ * A record cut short at the end of the file (a write torn by a crash) ends the journal.
+ */
+class JournalReader
+{
+
+public:
+
+    // ctor, opens and validates the file header
+    JournalReader(const string& _path);
+
+    // Read the next record, false at the end of the journal
+    bool Next(JournalRecordHeader& _header, vector<char>& _payload);
+
+private:
+    ifstream file;
+};
+
+JournalReader::JournalReader(const string& _path)
+{
+    file.open(_path, ios::binary);
+    if (!file) throw runtime_error("Journal: cannot open " + _path);
+    uint32_t _preamble[2];
+    file.read(reinterpret_cast<char*>(_preamble), sizeof(_preamble));
+    if (file.gcount() != sizeof(_preamble) || _preamble[0] != JOURNAL_MAGIC) throw runtime_error("Journal: not a journal " + _path);
+    if (_preamble[1] != JOURNAL_VERSION) throw runtime_error("Journal: unsupported version in " + _path);
+}
+
+bool JournalReader::Next(JournalRecordHeader& _header, vector<char>& _payload)
+{
+    file.read(reinterpret_cast<char*>(&_header), sizeof(_header));
+    if (file.gcount() != sizeof(_header)) return false;
+    _payload.resize(_header.length);
+    file.read(_payload.data(), _header.length);
+    return static_cast<size_t>(file.gcount()) == _header.length;
+}
+
+/**
+ * Append-only journal of inbound messages.
+ * Records are buffered and written out every JOURNAL_FLUSH_BYTES, on Flush() and on destruction;
+ * Flush() and destruction also sync the file.
+ */
+class Journal
+{
+
+public:
+
+    // ctor, starts a new journal at _path, or continues its sequence when _append is set
+    Journal(const string& _path, bool _append = false);
+
+    // dtor, writes out what is buffered
+    ~Journal();
+
+    // Append a record, returns its sequence number
+    uint64_t Append(JournalRecordType _type, const char* _data, size_t _size);
+
+    // Append a trivially copyable record
+    template<typename P>
+    uint64_t Append(JournalRecordType _type, const P& _record);
+
+    // Write the buffered records to the file and sync it; throws runtime_error if either fails
+    void Flush();
+
+    // Get the sequence number of the last record
+    uint64_t GetSequence() const { return sequence; }
+
+private:
+
+    // Write the buffered records, with the lock held
+    void WriteBuffer();
+
+    // Sync the file to the disk, false if it failed
+    bool Sync();
+
+    ofstream file;
+    int syncDescriptor;
+    vector<char> buffer;
+    uint64_t sequence;
+    mutex lock;
+};
+
+Journal::Journal(const string& _path, bool _append)
+{
+    sequence = 0;
+    syncDescriptor = -1;
+    if (_append && ifstream(_path)) {
+        // continue after the last complete record; a torn tail is cut off
+        JournalReader _reader(_path);
+        JournalRecordHeader _header;
+        vector<char> _payload;
+        size_t _end = 2 * sizeof(uint32_t);
+        while (_reader.Next(_header, _payload)) {
+            sequence = _header.sequence;
+            _end += sizeof(_header) + _header.length;
+        }
+        filesystem::resize_file(_path, _end);
+        file.open(_path, ios::binary | ios::app);
+    }
+    else {
+        file.open(_path, ios::binary | ios::trunc);
+        uint32_t _preamble[2] = { JOURNAL_MAGIC, JOURNAL_VERSION };
+        file.write(reinterpret_cast<const char*>(_preamble), sizeof(_preamble));
+    }
+    if (!file) throw runtime_error("Journal: cannot open " + _path);
+#ifdef JOURNAL_FSYNC
+    // ofstream has no descriptor to sync, so the file is synced through one of its own
+    syncDescriptor = open(_path.c_str(), O_WRONLY);
+    if (syncDescriptor < 0) throw runtime_error("Journal: cannot open " + _path + " to sync");
+#endif
+    buffer.reserve(JOURNAL_FLUSH_BYTES * 2);
+}
+
+Journal::~Journal()
+{
+    // no throwing from here, a failed final write shows up as a torn tail
+    lock_guard<mutex> _guard(lock);
+    file.write(buffer.data(), buffer.size());
+    file.flush();
+    Sync();
+#ifdef JOURNAL_FSYNC
+    close(syncDescriptor);
+#endif
+}
+
+uint64_t Journal::Append(JournalRecordType _type, const char* _data, size_t _size)
+{
+    lock_guard<mutex> _guard(lock);
+    JournalRecordHeader _header;
+    memset(&_header, 0, sizeof(_header));
+    _header.sequence = ++sequence;
+    _header.timestamp = ClockNow();
+    _header.type = _type;
+    _header.length = static_cast<uint32_t>(_size);
+
+    const char* _bytes = reinterpret_cast<const char*>(&_header);
+    buffer.insert(buffer.end(), _bytes, _bytes + sizeof(_header));
+    buffer.insert(buffer.end(), _data, _data + _size);
+    if (buffer.size() >= JOURNAL_FLUSH_BYTES) WriteBuffer();
+    return _header.sequence;
+}
+
+template<typename P>
+uint64_t Journal::Append(JournalRecordType _type, const P& _record)
+{
+    static_assert(is_trivially_copyable<P>::value, "journal records must be trivially copyable");
+    return Append(_type, reinterpret_cast<const char*>(&_record), sizeof(P));
+}
+
+void Journal::Flush()
+{
+    lock_guard<mutex> _guard(lock);
+    WriteBuffer();
+    file.flush();
+    if (!file || !Sync()) throw runtime_error("Journal: sync failed");
+}
+
+bool Journal::Sync()
+{
+#ifdef JOURNAL_FSYNC
+    return fsync(syncDescriptor) == 0;
+#else
+    return true;
+#endif
+}
+
+void Journal::WriteBuffer()
+{
+    file.write(buffer.data(), buffer.size());
+    if (!file) throw runtime_error("Journal: write failed");
+    buffer.clear();
+}
+
+#endif
@@ -0,0 +1,317 @@
+/**
+ * journalreplay.hpp
+ * Defines the replayer re-driving the services from a journal of inbound messages,
+ * and the listener journaling what crosses a timing-dependent link.
+ * Several journals are merged by event time. Records are handed to the services
+ * exactly as their connectors handed them over when the journals were written,
+ * paced at the original speed, a multiple of it, or as fast as possible.
+ *
+ * @author Lexie Zhu
+ */
+#ifndef JOURNAL_REPLAY_HPP
+#define JOURNAL_REPLAY_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <map>
+#include <chrono>
+#include <filesystem>
+#include <thread>
+#include <cstring>
+#include <stdexcept>
+#include "soa.hpp"
+#include "clock.hpp"
+#include "journal.hpp"
+#include "pricingservice.hpp"
+#include "marketdataservice.hpp"
+#include "tradebookingservice.hpp"
+#include "inquiryservice.hpp"
+
+using namespace std;
+
+// Get the name a journal's position is kept under; journals number their records independently
+string JournalKey(const string& _path)
+{
+    return filesystem::path(_path).lexically_normal().string();
+}
+
+// Get the earliest event time across journals, 0 if they are all empty
+int64_t JournalStartTime(const vector<string>& _paths)
+{
+    int64_t _start = 0;
+    JournalRecordHeader _header;
+    vector<char> _payload;
+    for (auto& _path : _paths) {
+        JournalReader _reader(_path);
+        if (_reader.Next(_header, _payload) && (_start == 0 || _header.timestamp < _start)) _start = _header.timestamp;
+    }
+    return _start;
+}
+
+// Encode a fixed-layout message
+template<typename V>
+void EncodeRecord(const V& _data, vector<char>& _out)
+{
+    auto _compact = _data.ToCompact();
+    const char* _bytes = reinterpret_cast<const char*>(&_compact);
+    _out.assign(_bytes, _bytes + sizeof(_compact));
+}
+
+// Encode an order book, whose layout depends on its depth
+template<typename T>
+void EncodeRecord(const OrderBook<T>& _data, vector<char>& _out)
+{
+    _out.clear();
+    _data.ToCompact(_out);
+}
+
+/**
+ * Listener journaling each message before passing it on to another listener.
+ * Type V is the message type.
+ */
+template<typename V>
+class JournalingListener : public ServiceListener<V>
+{
+
+public:
+
+    // ctor, a null journal passes messages on without journaling them
+    JournalingListener(ServiceListener<V>* _listener, Journal* _journal, JournalRecordType _type);
+
+    // Journal and pass on
+    void ProcessAdd(V& _data) override;
+
+    void ProcessRemove(V& _data) override { listener->ProcessRemove(_data); }
+
+    void ProcessUpdate(V& _data) override { listener->ProcessUpdate(_data); }
+
+private:
+    ServiceListener<V>* listener;
+    Journal* journal;
+    JournalRecordType type;
+    vector<char> record;
+};
+
+template<typename V>
+JournalingListener<V>::JournalingListener(ServiceListener<V>* _listener, Journal* _journal, JournalRecordType _type)
+{
+    listener = _listener;
+    journal = _journal;
+    type = _type;
+}
+
+template<typename V>
+void JournalingListener<V>::ProcessAdd(V& _data)
+{
+    TRACE_SCOPE("JournalingListener::ProcessAdd");
+    TRACE_PRODUCT(_data.GetProduct());
+    if (journal) {
+        EncodeRecord(_data, record);
+        journal->Append(type, record.data(), record.size());
+    }
+    listener->ProcessAdd(_data);
+}
+
+/**
+ * Replayer of a journal into the inbound services.
+ * Type T is the product type.
+ */
+template<typename T>
+class JournalReplayer
+{
+
+public:
+
+    // ctor
+    JournalReplayer(PricingService<T>* _pricingService, MarketDataService<T>* _marketDataService,
+        TradeBookingService<T>* _tradeBookingService, InquiryService<T>* _inquiryService);
+
+    // Receive the journaled books of the algo link; without it they are skipped
+    void SetAlgoListener(ServiceListener<OrderBook<T>>* _listener) { algoListener = _listener; }
+
+    // Move _clock to the event time of each record before it is handed over
+    void SetClock(VirtualClock* _clock) { clock = _clock; }
+
+    // Pace at _speed times the original speed; 0 replays as fast as possible
+    void SetSpeed(double _speed) { speed = _speed; }
+
+    // Skip the records of the journal at _path up to _sequence, whose effect a restored snapshot already holds
+    void SetStartAfter(const string& _path, uint64_t _sequence) { startAfter[JournalKey(_path)] = _sequence; }
+
+    // Replay every record of the journal at _path, returns the number replayed
+    long Replay(const string& _path);
+
+    // Replay every record of the journals at _paths merged by event time, returns the number replayed
+    long Replay(const vector<string>& _paths);
+
+    // Get the sequence number of the last record replayed from the journal at _path, 0 if none
+    uint64_t GetSequence(const string& _path) const;
+
+private:
+
+    // A journal being merged, with its next record
+    struct Source
+    {
+        Source(const string& _path) : key(JournalKey(_path)), reader(_path), sequence(0) {}
+        string key;
+        JournalReader reader;
+        JournalRecordHeader header;
+        vector<char> payload;
+        uint64_t sequence;
+    };
+
+    // Read the next record of a source, false when it is exhausted
+    static bool Advance(Source& _source);
+
+    // Hand one record to its service
+    void Dispatch(const JournalRecordHeader& _header, const vector<char>& _payload);
+
+    // Copy a fixed-size payload out of a record
+    template<typename C>
+    static C Decode(const JournalRecordHeader& _header, const vector<char>& _payload);
+
+    PricingService<T>* pricingService;
+    MarketDataService<T>* marketDataService;
+    TradeBookingService<T>* tradeBookingService;
+    InquiryService<T>* inquiryService;
+    ServiceListener<OrderBook<T>>* algoListener;
+    VirtualClock* clock;
+    double speed;
+    map<string, uint64_t> startAfter; // by journal
+    map<string, uint64_t> replayed; // last sequence replayed, by journal
+};
+
+template<typename T>
+JournalReplayer<T>::JournalReplayer(PricingService<T>* _pricingService, MarketDataService<T>* _marketDataService,
+    TradeBookingService<T>* _tradeBookingService, InquiryService<T>* _inquiryService)
+{
+    pricingService = _pricingService;
+    marketDataService = _marketDataService;
+    tradeBookingService = _tradeBookingService;
+    inquiryService = _inquiryService;
+    algoListener = nullptr;
+    clock = nullptr;
+    speed = 0;
+}
+
+template<typename T>
+uint64_t JournalReplayer<T>::GetSequence(const string& _path) const
+{
+    auto _it = replayed.find(JournalKey(_path));
+    return _it == replayed.end() ? 0 : _it->second;
+}
+
+template<typename T>
+long JournalReplayer<T>::Replay(const string& _path)
+{
+    return Replay(vector<string>{ _path });
+}
+
+template<typename T>
+bool JournalReplayer<T>::Advance(Source& _source)
+{
+    if (!_source.reader.Next(_source.header, _source.payload)) return false;
+
+    // a gap means records were lost, and the replayed state would silently differ
+    if (_source.sequence != 0 && _source.header.sequence != _source.sequence + 1) {
+        throw runtime_error("JournalReplayer: sequence gap after " + to_string(_source.sequence));
+    }
+    _source.sequence = _source.header.sequence;
+    return true;
+}
+
+template<typename T>
+long JournalReplayer<T>::Replay(const vector<string>& _paths)
+{
+    vector<unique_ptr<Source>> _sources;
+    for (auto& _path : _paths) {
+        _sources.emplace_back(new Source(_path));
+        if (!Advance(*_sources.back())) _sources.pop_back();
+    }
+
+    long _count = 0;
+    int64_t _firstEventTime = 0;
+    auto _wallStart = chrono::steady_clock::now();
+    while (!_sources.empty())
+    {
+        // earliest event next; ties go to the journal listed first
+        size_t _next = 0;
+        for (size_t i = 1; i < _sources.size(); i++) {
+            if (_sources[i]->header.timestamp < _sources[_next]->header.timestamp) _next = i;
+        }
+        Source& _source = *_sources[_next];
+        auto _start = startAfter.find(_source.key);
+        if (_start != startAfter.end() && _source.header.sequence <= _start->second) {
+            if (!Advance(_source)) _sources.erase(_sources.begin() + _next);
+            continue;
+        }
+
+        int64_t _eventTime = _source.header.timestamp;
+        if (_count == 0) _firstEventTime = _eventTime;
+        if (speed > 0) {
+            auto _due = _wallStart + chrono::nanoseconds(static_cast<int64_t>((_eventTime - _firstEventTime) / speed));
+            this_thread::sleep_until(_due);
+        }
+        if (clock) clock->Set(_eventTime);
+
+        replayed[_source.key] = _source.header.sequence;
+        Dispatch(_source.header, _source.payload);
+        _count++;
+        if (!Advance(_source)) _sources.erase(_sources.begin() + _next);
+    }
+
+    // quote whatever is left of the last inquiry batch, as the inquiry connector does at the end of its feed
+    inquiryService->ProcessPendingInquiries();
+    return _count;
+}
+
+template<typename T>
+template<typename C>
+C JournalReplayer<T>::Decode(const JournalRecordHeader& _header, const vector<char>& _payload)
+{
+    if (_payload.size() != sizeof(C)) {
+        throw runtime_error("JournalReplayer: malformed record " + to_string(_header.sequence));
+    }
+    C _compact;
+    memcpy(&_compact, _payload.data(), sizeof(C));
+    return _compact;
+}
+
+template<typename T>
+void JournalReplayer<T>::Dispatch(const JournalRecordHeader& _header, const vector<char>& _payload)
+{
+    switch (_header.type)
+    {
+    case JOURNAL_PRICE: {
+        Price<T> _price = Price<T>::FromCompact(Decode<CompactPrice>(_header, _payload));
+        pricingService->OnMessage(_price);
+        break;
+    }
+    case JOURNAL_ORDER_BOOK: {
+        OrderBook<T> _orderBook = OrderBook<T>::FromCompact(_payload.data(), _payload.size());
+        marketDataService->OnMessage(_orderBook);
+        break;
+    }
+    case JOURNAL_ALGO_ORDER_BOOK: {
+        if (!algoListener) break;
+        OrderBook<T> _orderBook = OrderBook<T>::FromCompact(_payload.data(), _payload.size());
+        algoListener->ProcessAdd(_orderBook);
+        break;
+    }
+    case JOURNAL_TRADE: {
+        Trade<T> _trade = Trade<T>::FromCompact(Decode<CompactTrade>(_header, _payload));
+        tradeBookingService->OnMessage(_trade);
+        break;
+    }
+    case JOURNAL_INQUIRY: {
+        Inquiry<T> _inquiry = Inquiry<T>::FromCompact(Decode<CompactInquiry>(_header, _payload));
+        inquiryService->OnMessage(_inquiry);
+        break;
+    }
+    default:
+        throw runtime_error("JournalReplayer: unknown record type in record " + to_string(_header.sequence));
+    }
+}
+
+#endif
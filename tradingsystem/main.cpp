@@ -5,6 +5,7 @@
 #include "products.hpp"
 #include "algoexecutionservice.hpp"
 #include "algostreamingservice.hpp"
+#include "analyticsservice.hpp"
 #include "executionservice.hpp"
 #include "GUIservice.hpp"
 #include "historicaldataservice.hpp"
@@ -16,8 +17,17 @@
 #include "streamingservice.hpp"
 #include "tradebookingservice.hpp"
 #include "datageneration.hpp"
+#include "conflation.hpp"
+#include "channel.hpp"
+#include "feedscheduler.hpp"
+#include "reactor.hpp"
+#include "snapshot.hpp"
+#include "journal.hpp"
+#include "journalreplay.hpp"
 #include "utilities.hpp"
 #include <random>
+#include <memory>
+#include <map>
 
 void initialize() {
     GenerateAllPrices();
@@ -26,10 +36,192 @@ void initialize() {
     GenerateAllInquiryData();
 }
 
-int main() {
+// Start a historical writer on its own thread; writers can lag, so they wait cheaply
+template<typename V>
+void StartWriter(ChannelListener<V>& _writer) {
+    _writer.SetStage(STAGE_HISTORICAL);
+    _writer.SetWaitStrategy(WAIT_BACKOFF);
+    _writer.Start();
+}
+
+// Stop a historical writer once everything it was handed is written, and report its channel
+template<typename V>
+void StopWriter(const string& _name, ChannelListener<V>& _writer) {
+    _writer.Stop();
+    const BoundedChannel<V>& _channel = _writer.GetChannel();
+    std::cout << GetTimeStamp() << " History " << _name << ": " << _writer.GetDeliveredCount() << " written, depth high-water "
+              << _channel.GetHighWater() << "/" << _channel.GetCapacity() << ", " << _channel.GetBlocked() << " waits, "
+              << _channel.GetDropped() << " dropped." << std::endl;
+}
+
+// Give a listener behind a channel a thread of its own, so it no longer holds up the other listeners of its service
+template<typename V>
+void StartFanOut(const string& _stage, ChannelListener<V>& _listener) {
+    _listener.SetStage(_stage);
+    _listener.Start();
+}
+
+// Take a fanned-out listener back onto the thread of its service once it has caught up, and report its channel
+template<typename V>
+void StopFanOut(const string& _name, ChannelListener<V>& _listener) {
+    if (!_listener.IsRunning()) return;
+    _listener.Stop();
+    const BoundedChannel<V>& _channel = _listener.GetChannel();
+    std::cout << GetTimeStamp() << " Fan-out " << _name << ": " << _listener.GetDeliveredCount() << " delivered, depth high-water "
+              << _channel.GetHighWater() << "/" << _channel.GetCapacity() << ", " << _channel.GetBlocked() << " waits, "
+              << _channel.GetCoalesced() << " coalesced." << std::endl;
+}
+
+// Report the depth and overflow counters of the channel of a listener
+template<typename V>
+void AddChannelMetrics(MetricsRegistry& _registry, const string& _name, const ChannelListener<V>& _listener) {
+    const BoundedChannel<V>& _channel = _listener.GetChannel();
+    _registry.AddGauges(_name, {
+        { "depth", [&_channel]() { return int64_t(_channel.Size()); } },
+        { "high_water", [&_channel]() { return int64_t(_channel.GetHighWater()); } },
+        { "capacity", [&_channel]() { return int64_t(_channel.GetCapacity()); } },
+        { "delivered", [&_listener]() { return int64_t(_listener.GetDeliveredCount()); } },
+        { "waits", [&_channel]() { return int64_t(_channel.GetBlocked()); } },
+        { "dropped", [&_channel]() { return int64_t(_channel.GetDropped()); } },
+        { "coalesced", [&_channel]() { return int64_t(_channel.GetCoalesced()); } } });
+}
+
+// The usage line, printed on a bad argument
+const string USAGE = "Usage: test [--securities <file>] [--placement <file>] [--wait <strategy>] [--interleave <batch>] [--feed <name>=<endpoint>]... [--batch <max>] [--fanout] [--conflate] [--metrics <seconds>] [--metrics-socket <path>] [--restore <snapshot>] [--replay <journal>]... [--speed <multiple>] [--history text|binary]";
+// --securities adds the securities of a reference data file to the compiled-in ones;
+// snapshots, journals and history files refer to products by handle, so read them with the same file.
+// --placement assigns the pipeline stages to cores and NUMA nodes; see placement.hpp.
+// --conflate runs algo execution on a thread of its own behind a channel conflated per product, so it only sees the
+// freshest order book of a product once it falls behind; without it every order book reaches algo execution in turn.
+// --wait sets how algo execution waits for order books on that thread: busy-spin, spin-yield, blocking (the default) or backoff.
+// --interleave reads the four feeds together on the main thread, <batch> records of each in turn (needs -std=c++20);
+// algo execution then runs on the main thread as well, so every trade is booked on one thread.
+// --feed takes the price, trade, market or inquiry feed live from an endpoint, unix:<path>, tcp:[<host>:]<port>
+// or fifo:<path>, instead of from its file; the live feeds are read together on the main thread (Linux only).
+// With a live trade feed, algo execution runs on the main thread too, so every trade is booked on one thread.
+// --feed <name>=file:<path> reads a feed from another file; a file ending in .z is a compressed feed (see feedcompress.cpp).
+// --batch caps the runs of prices handed down the pricing, streaming and analytics path at once (default 64, 1 for one at a time);
+// runs grow while the price feed is ahead and shrink back to single prices when it is idle.
+// --fanout runs the GUI and analytics listeners of pricing, and trade booking behind execution, on threads of their own,
+// each through its own channel, so a slow one no longer delays the others; trade booking only while the trade feed is not read alongside.
+// --metrics writes the counters of every service, connector and channel to metrics.txt every <seconds>, and once more at the end;
+// --metrics-socket answers each connection to a Unix-domain socket with the same snapshot, e.g. nc -U <path>.
+// The state of the stateful services is saved to snapshot.bin on exit, with the sequence of the last journal record it holds;
+// with --restore the services start from a saved snapshot instead of empty.
+// Inbound messages are journaled to inbound.journal, continued rather than restarted by a restored run;
+// with --replay the services are driven from journals merged by event time instead of from the data files,
+// at --speed times the original pace (0, the default, is as fast as possible), skipping the records a restored snapshot holds.
+// --history binary persists historical data to compressed .hist files instead of .txt.
+// Built with -DTRADING_TRACE, the steps of every message are traced to trace.bin; see tracetojson.cpp.
+int main(int argc, char* argv[]) {
+    TRACE_THREAD("main");
+    string restorePath;
+    vector<string> replayPaths;
+    double replaySpeed = 0;
+    HistoryFormat historyFormat = HISTORY_TEXT;
+    string securitiesPath;
+    string placementPath;
+    WaitStrategyType algoWait = WAIT_BLOCKING;
+    long interleaveBatch = 0;
+    size_t maxBatch = MAX_BATCH_SIZE;
+    bool fanOut = false;
+    bool conflateAlgo = false;
+    double metricsPeriod = 0;
+    string metricsSocket;
+    map<string, string> feedEndpoints;
+    map<string, string> feedFiles{ { "price", "prices.txt" }, { "trade", "trades.txt" }, { "market", "marketdata.txt" }, { "inquiry", "inquiries.txt" } };
+    int i = 1;
+    try {
+        for (; i < argc; i += 2) {
+            if (string(argv[i]) == "--fanout") {
+                fanOut = true;
+                i--;
+            }
+            else if (string(argv[i]) == "--conflate") {
+                conflateAlgo = true;
+                i--;
+            }
+            else if (i + 1 == argc) break;
+            else if (string(argv[i]) == "--securities") securitiesPath = argv[i + 1];
+            else if (string(argv[i]) == "--placement") placementPath = argv[i + 1];
+            else if (string(argv[i]) == "--wait") algoWait = ParseWaitStrategy(argv[i + 1]);
+            else if (string(argv[i]) == "--interleave") interleaveBatch = stol(argv[i + 1]);
+            else if (string(argv[i]) == "--feed") {
+                string feed = argv[i + 1];
+                size_t separator = feed.find('=');
+                feedEndpoints[feed.substr(0, separator)] = separator == string::npos ? string() : feed.substr(separator + 1);
+            }
+            else if (string(argv[i]) == "--batch") maxBatch = stoul(argv[i + 1]);
+            else if (string(argv[i]) == "--metrics") metricsPeriod = stod(argv[i + 1]);
+            else if (string(argv[i]) == "--metrics-socket") metricsSocket = argv[i + 1];
+            else if (string(argv[i]) == "--restore") restorePath = argv[i + 1];
+            else if (string(argv[i]) == "--replay") replayPaths.push_back(argv[i + 1]);
+            else if (string(argv[i]) == "--speed") replaySpeed = stod(argv[i + 1]);
+            else if (string(argv[i]) == "--history") historyFormat = string(argv[i + 1]) == "binary" ? HISTORY_BINARY : HISTORY_TEXT;
+        }
+    }
+    catch (const exception& e) {
+        // a malformed number or an unknown wait strategy
+        std::cerr << "Bad value " << argv[i + 1] << " for " << argv[i] << " (" << e.what() << ")." << std::endl << USAGE << std::endl;
+        return 1;
+    }
+    bool replay = !replayPaths.empty();
+
+    // the product universe is fixed before any service starts
+    if (!securitiesPath.empty()) {
+        try {
+            size_t loaded = ProductRegistry::Instance().Load(securitiesPath);
+            std::cout << "Loaded " << loaded << " securities, " << ProductRegistry::Instance().Size() << " products.\n";
+        }
+        catch (const exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    for (auto f = feedEndpoints.begin(); f != feedEndpoints.end(); ) {
+        if (!feedFiles.count(f->first)) {
+            std::cerr << "Unknown feed " << f->first << "; feeds are price, trade, market and inquiry." << std::endl;
+            return 1;
+        }
+        if (f->second.compare(0, 5, "file:") == 0) {
+            feedFiles[f->first] = f->second.substr(5);
+            f = feedEndpoints.erase(f);
+            continue;
+        }
+#ifdef FEED_REACTOR
+        try {
+            ParseEndpoint(f->second);
+        }
+        catch (const exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+#endif
+        ++f;
+    }
+#ifndef FEED_REACTOR
+    if (!feedEndpoints.empty()) std::cout << "--feed needs Linux epoll; reading every feed from its file." << std::endl;
+    feedEndpoints.clear();
+#endif
+
+    // the main thread ingests the feeds and runs every stage without a thread of its own
+    if (!placementPath.empty()) {
+        try {
+            ThreadPlacements().Load(placementPath);
+        }
+        catch (const exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+    PlaceThread(STAGE_INGEST);
+
+    // a replay runs on event time from the start, so every service sees one consistent clock
+    VirtualClock replayClock(replay ? JournalStartTime(replayPaths) : 0);
+    if (replay) SetClock(&replayClock);
+
     std::cout << GetTimeStamp() << " Program Started. " << std::endl;
-    initialize(); // run if there are no existing data txts
-    std::cout << GetTimeStamp() << " Data Prepared." << std::endl;
 
     // Initialization.
     MarketDataService<Bond> BondMarketDataService;
@@ -43,51 +235,320 @@ int main() {
     StreamingService<Bond> BondStreamingService;
     InquiryService<Bond> BondInquiryService;
     GUIService<Bond> BondGUIService;
+    AnalyticsService<Bond> BondAnalyticsService;
     std::cout << "Services initialized.\n";
 
+    // a live run journals its inbound messages; a replay only reads its journal
+    const string liveJournal = JournalKey("inbound.journal");
+    unique_ptr<Journal> journal;
+    if (!replay) journal.reset(new Journal(liveJournal, !restorePath.empty()));
+    map<string, uint64_t> journalSequences; // of the last record the services have seen, by journal
+
     //historical service initialization.
     HistoricalDataService<Position<Bond>> histPositionService(POSITION);
     HistoricalDataService<PV01<Bond>> histRiskService(RISK);
     HistoricalDataService<ExecutionOrder<Bond>> histExecutionService(EXECUTION);
     HistoricalDataService<PriceStream<Bond>> histStreamingService(STREAMING);
     HistoricalDataService<Inquiry<Bond>> histInquiryService(INQUIRY);
+    histPositionService.SetFormat(historyFormat);
+    histRiskService.SetFormat(historyFormat);
+    histExecutionService.SetFormat(historyFormat);
+    histStreamingService.SetFormat(historyFormat);
+    histInquiryService.SetFormat(historyFormat);
     std::cout << "Historical services initialized." << std::endl;
 
+    // the writers run behind bounded channels; a full channel holds the producer back rather than grow
+    const size_t historyCapacity = 4096;
+    ChannelListener<Position<Bond>> positionToHistory(histPositionService.GetServiceListener(), historyCapacity, OVERFLOW_BLOCK);
+    ChannelListener<PV01<Bond>> riskToHistory(histRiskService.GetServiceListener(), historyCapacity, OVERFLOW_BLOCK);
+    ChannelListener<ExecutionOrder<Bond>> executionToHistory(histExecutionService.GetServiceListener(), historyCapacity, OVERFLOW_BLOCK);
+    ChannelListener<PriceStream<Bond>> streamingToHistory(histStreamingService.GetServiceListener(), historyCapacity, OVERFLOW_BLOCK);
+    ChannelListener<Inquiry<Bond>> inquiryToHistory(histInquiryService.GetServiceListener(), historyCapacity, OVERFLOW_BLOCK);
+
+    // independent listeners sit behind channels of their own; they only take a thread with --fanout
+    ChannelListener<Price<Bond>> pricingToGUI(BondGUIService.GetListener(), CONFLATION_CAPACITY, OVERFLOW_CONFLATE); // the GUI only shows the latest
+    ChannelListener<Price<Bond>> pricingToAnalytics(BondAnalyticsService.GetListener(), historyCapacity, OVERFLOW_BLOCK);
+    ChannelListener<ExecutionOrder<Bond>> executionToBooking(BondTradeBookingService.GetListener(), historyCapacity, OVERFLOW_BLOCK);
+
     // Linking
-    BondPricingService.AddListener(BondGUIService.GetListener()); //GUI listens to PricingService
+    BondPricingService.AddListener(&pricingToGUI); //GUI listens to PricingService
     BondPricingService.AddListener(BondAlgoStreamingService.GetListener()); //histStreaming -> streaming -> AlgoStreaming -> Pricing
     BondAlgoStreamingService.AddListener(BondStreamingService.GetListener());
-    BondStreamingService.AddListener(histStreamingService.GetServiceListener());
-    BondMarketDataService.AddListener(BondAlgoExecutionService.GetListener());//histExe -> Exe -> AlgoExe -> MarketData
+    BondPricingService.AddListener(&pricingToAnalytics); // yields and durations from mids
+    BondStreamingService.AddListener(&streamingToHistory);
+    JournalingListener<OrderBook<Bond>> journaledAlgo(BondAlgoExecutionService.GetListener(), journal.get(), JOURNAL_ALGO_ORDER_BOOK);
+    ConflatingListener<OrderBook<Bond>> marketDataToAlgo(&journaledAlgo); // freshest book per product when algo lags
+    marketDataToAlgo.SetStage(STAGE_ALGO_EXECUTION);
+    marketDataToAlgo.SetWaitStrategy(algoWait);
+    if (!replay) BondMarketDataService.AddListener(&marketDataToAlgo);//histExe -> Exe -> AlgoExe -> MarketData
     BondAlgoExecutionService.AddListener(BondExecutionService.GetListener());
-    BondExecutionService.AddListener(histExecutionService.GetServiceListener());
-    BondExecutionService.AddListener(BondTradeBookingService.GetListener()); // TradeBooking -> Execution.
+    BondExecutionService.AddListener(&executionToHistory);
+    BondExecutionService.AddListener(&executionToBooking); // TradeBooking -> Execution.
     BondTradeBookingService.AddListener(BondPositionService.GetListener());//histPos -> Pos histRisk -> Risk
     BondPositionService.AddListener(BondRiskService.GetListener());
-    BondPositionService.AddListener(histPositionService.GetServiceListener());//Risk -> Pos
-    BondRiskService.AddListener(histRiskService.GetServiceListener()); //Pos -> Trade Booking
-    BondInquiryService.AddListener(histInquiryService.GetServiceListener());//histInquiry -> inquiry
+    BondPositionService.AddListener(&positionToHistory);//Risk -> Pos
+    BondRiskService.AddListener(&riskToHistory); //Pos -> Trade Booking
+    BondRiskService.SetConflation(1000, 500); // publish the latest PV01 per product every 1000 updates or 500ms
+    BondInquiryService.AddListener(&inquiryToHistory);//histInquiry -> inquiry
+    BondPricingService.AddListener(BondInquiryService.GetPricingListener()); // inquiries are quoted off the mid
     std::cout << GetTimeStamp() << " Services linked successfully." << std::endl;
 
-    //load data
-    ifstream priceData("prices.txt");
-    ifstream tradeData("trades.txt");
-    ifstream inquiryData("inquiries.txt");
-    ifstream marketData("marketdata.txt");
-    std::cout << GetTimeStamp() << " Data linked successfully." << std::endl;
-
-    //read prices
-    BondPricingService.GetConnector()->Subscribe(priceData);
-    std::cout << GetTimeStamp() << " Price data processed." << std::endl;
-    //trade
-    BondTradeBookingService.GetConnector()->Subscribe(tradeData);
-    std::cout << GetTimeStamp() << " Trade data processed." << std::endl;
-    //market
-    BondMarketDataService.GetConnector()->Subscribe(marketData);
-    std::cout << GetTimeStamp() << " Market data processed." << std::endl;
-    //inquiry
-    BondInquiryService.GetConnector()->Subscribe(inquiryData);
-    std::cout << GetTimeStamp() << " Inquiry data processed." << std::endl;
+    // every counter is registered before anything reads them
+    MetricsRegistry metrics;
+    metrics.Add("pricing", BondPricingService.GetMetrics());
+    metrics.Add("pricing.connector", BondPricingService.GetConnector()->GetMetrics());
+    metrics.Add("algo_streaming", BondAlgoStreamingService.GetMetrics());
+    metrics.Add("streaming", BondStreamingService.GetMetrics());
+    metrics.Add("analytics", BondAnalyticsService.GetMetrics());
+    metrics.Add("gui", BondGUIService.GetMetrics());
+    metrics.Add("gui.connector", BondGUIService.GetConnector()->GetMetrics());
+    metrics.Add("market_data", BondMarketDataService.GetMetrics());
+    metrics.Add("market_data.connector", BondMarketDataService.GetConnector()->GetMetrics());
+    metrics.Add("algo_execution", BondAlgoExecutionService.GetMetrics());
+    metrics.Add("execution", BondExecutionService.GetMetrics());
+    metrics.Add("trade_booking", BondTradeBookingService.GetMetrics());
+    metrics.Add("trade_booking.connector", BondTradeBookingService.GetConnector()->GetMetrics());
+    metrics.Add("position", BondPositionService.GetMetrics());
+    metrics.Add("risk", BondRiskService.GetMetrics());
+    metrics.Add("inquiry", BondInquiryService.GetMetrics());
+    metrics.Add("inquiry.connector", BondInquiryService.GetConnector()->GetMetrics());
+    metrics.Add("history.positions", histPositionService.GetConnector()->GetMetrics());
+    metrics.Add("history.risk", histRiskService.GetConnector()->GetMetrics());
+    metrics.Add("history.executions", histExecutionService.GetConnector()->GetMetrics());
+    metrics.Add("history.streaming", histStreamingService.GetConnector()->GetMetrics());
+    metrics.Add("history.inquiries", histInquiryService.GetConnector()->GetMetrics());
+    AddChannelMetrics(metrics, "channel.market_data_to_algo", marketDataToAlgo);
+    AddChannelMetrics(metrics, "channel.pricing_to_gui", pricingToGUI);
+    AddChannelMetrics(metrics, "channel.pricing_to_analytics", pricingToAnalytics);
+    AddChannelMetrics(metrics, "channel.execution_to_booking", executionToBooking);
+    AddChannelMetrics(metrics, "channel.positions_to_history", positionToHistory);
+    AddChannelMetrics(metrics, "channel.risk_to_history", riskToHistory);
+    AddChannelMetrics(metrics, "channel.executions_to_history", executionToHistory);
+    AddChannelMetrics(metrics, "channel.streaming_to_history", streamingToHistory);
+    AddChannelMetrics(metrics, "channel.inquiries_to_history", inquiryToHistory);
+
+    ofstream metricsFile;
+    unique_ptr<MetricsReporter> metricsReporter;
+    if (metricsPeriod > 0) {
+        metricsFile.open("metrics.txt", ios::trunc);
+        metricsReporter.reset(new MetricsReporter(metrics, metricsFile, chrono::milliseconds(long(metricsPeriod * 1000))));
+        metricsReporter->Start();
+    }
+#ifdef METRICS_ENDPOINT
+    unique_ptr<MetricsEndpoint> metricsEndpoint;
+    if (!metricsSocket.empty()) {
+        try {
+            metricsEndpoint.reset(new MetricsEndpoint(metrics, metricsSocket));
+        }
+        catch (const exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        metricsEndpoint->Start();
+        std::cout << GetTimeStamp() << " Metrics served on " << metricsSocket << "." << std::endl;
+    }
+#else
+    if (!metricsSocket.empty()) std::cout << "--metrics-socket needs Unix-domain sockets; metrics are not served." << std::endl;
+#endif
+
+    if (!restorePath.empty()) {
+        SnapshotReader snapshot(restorePath);
+        BondPositionService.LoadSnapshot(snapshot);
+        BondRiskService.LoadSnapshot(snapshot);
+        BondMarketDataService.LoadSnapshot(snapshot);
+        BondInquiryService.LoadSnapshot(snapshot);
+        BondTradeBookingService.LoadSnapshot(snapshot);
+        BondAlgoExecutionService.LoadSnapshot(snapshot);
+        snapshot.BeginSection("JRNL");
+        uint64_t journals = snapshot.Read<uint64_t>();
+        for (uint64_t j = 0; j < journals; j++) {
+            string path = snapshot.ReadString();
+            journalSequences[path] = snapshot.Read<uint64_t>();
+        }
+        std::cout << GetTimeStamp() << " State restored from " << restorePath << " as of";
+        for (auto s = journalSequences.begin(); s != journalSequences.end(); ++s) {
+            std::cout << (s == journalSequences.begin() ? " record " : ", record ") << s->second << " of " << s->first;
+        }
+        std::cout << "." << std::endl;
+        if (journal && journal->GetSequence() != journalSequences[liveJournal]) {
+            std::cout << "inbound.journal ends at record " << journal->GetSequence() << ", so it does not continue the snapshot." << std::endl;
+        }
+    }
+
+    StartWriter(positionToHistory);
+    StartWriter(riskToHistory);
+    StartWriter(executionToHistory);
+    StartWriter(streamingToHistory);
+    StartWriter(inquiryToHistory);
+    if (fanOut) {
+        StartFanOut(STAGE_GUI, pricingToGUI);
+        StartFanOut(STAGE_ANALYTICS, pricingToAnalytics);
+    }
+
+    if (replay) {
+        JournalReplayer<Bond> replayer(&BondPricingService, &BondMarketDataService, &BondTradeBookingService, &BondInquiryService);
+        replayer.SetAlgoListener(BondAlgoExecutionService.GetListener()); // the books algo execution saw live, not re-conflated
+        replayer.SetClock(&replayClock);
+        replayer.SetSpeed(replaySpeed);
+        for (auto& p : replayPaths) replayer.SetStartAfter(p, journalSequences[JournalKey(p)]);
+        long replayed = replayer.Replay(replayPaths);
+        for (auto& p : replayPaths) {
+            uint64_t& sequence = journalSequences[JournalKey(p)];
+            sequence = max(sequence, replayer.GetSequence(p));
+        }
+        BondRiskService.Flush();
+        std::cout << GetTimeStamp() << " Replayed " << replayed << " records from " << replayPaths.size() << " journal(s)." << std::endl;
+    }
+    else {
+        // generated after any restore, so the client ids continue past those the snapshot holds
+        initialize();
+        std::cout << GetTimeStamp() << " Data Prepared." << std::endl;
+
+        //load data; the feeds not taken live are read from their files
+        map<string, unique_ptr<ByteSource>> feedSources;
+        try {
+            for (auto& f : feedFiles) {
+                if (!feedEndpoints.count(f.first)) feedSources[f.first] = OpenFeedSource(f.second);
+            }
+        }
+        catch (const exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+        std::cout << GetTimeStamp() << " Data linked successfully." << std::endl;
+
+        BondPricingService.GetConnector()->SetMaxBatchSize(maxBatch);
+
+        // journal every inbound message ahead of the services
+        BondPricingService.GetConnector()->SetJournal(journal.get());
+        BondTradeBookingService.GetConnector()->SetJournal(journal.get());
+        BondMarketDataService.GetConnector()->SetJournal(journal.get());
+        BondInquiryService.GetConnector()->SetJournal(journal.get());
+
+#ifdef FEED_REACTOR
+        if (!feedEndpoints.empty()) {
+            // the live feeds are read together as their data arrives; the rest follow from their files
+            FeedReactor reactor;
+            try {
+                for (auto& f : feedEndpoints) {
+                    if (f.first == "price") reactor.AddFeed(f.first, f.second, BondPricingService.GetConnector());
+                    else if (f.first == "trade") reactor.AddFeed(f.first, f.second, BondTradeBookingService.GetConnector());
+                    else if (f.first == "market") reactor.AddFeed(f.first, f.second, BondMarketDataService.GetConnector());
+                    else reactor.AddFeed(f.first, f.second, BondInquiryService.GetConnector());
+                    std::cout << GetTimeStamp() << " Listening for the " << f.first << " feed on " << f.second << "." << std::endl;
+                }
+            }
+            catch (const exception& e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+            // algo execution and trade booking only take threads if no live trade feed books on this one
+            bool liveTrades = feedEndpoints.count("trade") > 0;
+            if (conflateAlgo && !liveTrades) marketDataToAlgo.Start();
+            if (fanOut && !liveTrades) StartFanOut(STAGE_BOOKING, executionToBooking);
+            // a quiet feed still publishes the pending risk on time, if risk is updated on this thread
+            if (liveTrades || (!conflateAlgo && !fanOut)) reactor.SetTick([&BondRiskService]() { BondRiskService.FlushIfDue(); }, 100);
+            long records = reactor.Run();
+            marketDataToAlgo.Stop();
+            StopFanOut("booking", executionToBooking);
+            BondRiskService.Flush();
+            std::cout << GetTimeStamp() << " " << records << " live records processed (" << marketDataToAlgo.GetCoalescedCount()
+                      << " order books coalesced)." << std::endl;
+        }
+#endif
+
+#ifdef FEED_COROUTINES
+        if (interleaveBatch > 0 && feedEndpoints.empty()) {
+            // one scheduler runs every feed, a batch of each in turn; algo execution runs inline too,
+            // as the executions it books would otherwise race the trade feed booking on this thread
+            FeedScheduler feeds;
+            feeds.Add("price", SubscribeFeed(BondPricingService.GetConnector(), *feedSources["price"], interleaveBatch));
+            feeds.Add("trade", SubscribeFeed(BondTradeBookingService.GetConnector(), *feedSources["trade"], interleaveBatch));
+            feeds.Add("market", SubscribeFeed(BondMarketDataService.GetConnector(), *feedSources["market"], interleaveBatch));
+            feeds.Add("inquiry", SubscribeFeed(BondInquiryService.GetConnector(), *feedSources["inquiry"], interleaveBatch));
+            long records = feeds.Run();
+            BondRiskService.Flush();
+            std::cout << GetTimeStamp() << " " << records << " records processed interleaved (" << feeds.GetRecords("price") << " price, "
+                      << feeds.GetRecords("trade") << " trade, " << feeds.GetRecords("market") << " market, " << feeds.GetRecords("inquiry")
+                      << " inquiry; " << marketDataToAlgo.GetCoalescedCount() << " order books coalesced)." << std::endl;
+        }
+        else
+#else
+        if (interleaveBatch > 0 && feedEndpoints.empty()) std::cout << "--interleave needs a build with C++20 coroutines; reading the feeds one after another." << std::endl;
+#endif
+        {
+            //read prices
+            if (feedSources.count("price")) {
+                BondPricingService.GetConnector()->Subscribe(*feedSources["price"]);
+                std::cout << GetTimeStamp() << " Price data processed." << std::endl;
+            }
+            //trade
+            if (feedSources.count("trade")) {
+                BondTradeBookingService.GetConnector()->Subscribe(*feedSources["trade"]);
+                std::cout << GetTimeStamp() << " Trade data processed." << std::endl;
+            }
+            //market
+            if (feedSources.count("market")) {
+                if (conflateAlgo) marketDataToAlgo.Start();
+                if (fanOut) StartFanOut(STAGE_BOOKING, executionToBooking);
+                BondMarketDataService.GetConnector()->Subscribe(*feedSources["market"]);
+                marketDataToAlgo.Stop();
+                StopFanOut("booking", executionToBooking);
+                std::cout << GetTimeStamp() << " Market data processed (" << marketDataToAlgo.GetCoalescedCount() << " order books coalesced)." << std::endl;
+                BondRiskService.Flush();
+            }
+            //inquiry
+            if (feedSources.count("inquiry")) {
+                BondInquiryService.GetConnector()->Subscribe(*feedSources["inquiry"]);
+                std::cout << GetTimeStamp() << " Inquiry data processed." << std::endl;
+            }
+        }
+
+        journal->Flush();
+        journalSequences[liveJournal] = journal->GetSequence();
+        BondPricingService.GetConnector()->SetJournal(nullptr);
+        BondTradeBookingService.GetConnector()->SetJournal(nullptr);
+        BondMarketDataService.GetConnector()->SetJournal(nullptr);
+        BondInquiryService.GetConnector()->SetJournal(nullptr);
+        std::cout << GetTimeStamp() << " " << journal->GetSequence() << " messages journaled." << std::endl;
+    }
+
+    StopFanOut("gui", pricingToGUI);
+    StopFanOut("analytics", pricingToAnalytics);
+    StopWriter("positions", positionToHistory);
+    StopWriter("risk", riskToHistory);
+    StopWriter("executions", executionToHistory);
+    StopWriter("streaming", streamingToHistory);
+    StopWriter("inquiries", inquiryToHistory);
+    if (metricsReporter) metricsReporter->Stop();
+
+    // all feeds are drained, so the snapshot is consistent
+    SnapshotWriter snapshot("snapshot.bin");
+    BondPositionService.SaveSnapshot(snapshot);
+    BondRiskService.SaveSnapshot(snapshot);
+    BondMarketDataService.SaveSnapshot(snapshot);
+    BondInquiryService.SaveSnapshot(snapshot);
+    BondTradeBookingService.SaveSnapshot(snapshot);
+    BondAlgoExecutionService.SaveSnapshot(snapshot);
+    snapshot.BeginSection("JRNL");
+    snapshot.Write(static_cast<uint64_t>(journalSequences.size()));
+    for (auto& s : journalSequences) {
+        snapshot.WriteString(s.first);
+        snapshot.Write(s.second);
+    }
+    snapshot.Commit();
+    std::cout << GetTimeStamp() << " State saved to snapshot.bin." << std::endl;
+
+#ifdef TRADING_TRACE
+    // every traced thread has stopped
+    try {
+        long events = Tracer::Instance().Write("trace.bin");
+        std::cout << GetTimeStamp() << " " << events << " trace events written to trace.bin." << std::endl;
+    }
+    catch (const exception& e) {
+        std::cerr << e.what() << std::endl;
+    }
+#endif
 
     std::cout << GetTimeStamp() << "Finished." << std::endl;
     system("sleep 5");
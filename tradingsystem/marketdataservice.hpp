@@ -11,8 +11,12 @@
 #include <vector>
 #include <unordered_map>
 #include <map>
+#include <stdexcept>
 #include "soa.hpp"
 #include "utilities.hpp"
+#include "compactmessages.hpp"
+#include "journal.hpp"
+#include "snapshot.hpp"
 
 
 using namespace std;
@@ -138,6 +142,12 @@ public:
     // Get the best bid/offer order
     const BidOffer GetBidOffer() const;
 
+    // Append the fixed layout of the book to _out
+    void ToCompact(vector<char>& _out) const;
+
+    // Rebuild a book from its fixed layout
+    static OrderBook<T> FromCompact(const char* _data, size_t _size);
+
 private:
     T product;
     vector<Order> bidStack;
@@ -150,6 +160,58 @@ OrderBook<T>::OrderBook(const T& _product, const vector<Order>& _bidStack, const
 {
 }
 
+template<typename T>
+void OrderBook<T>::ToCompact(vector<char>& _out) const
+{
+    CompactOrderBook _header;
+    memset(&_header, 0, sizeof(_header));
+    _header.product = GetProductHandle(product.GetProductId());
+    _header.bids = static_cast<uint32_t>(bidStack.size());
+    _header.offers = static_cast<uint32_t>(offerStack.size());
+
+    size_t _offset = _out.size();
+    _out.resize(_offset + sizeof(CompactOrderBook) + (bidStack.size() + offerStack.size()) * sizeof(CompactOrder));
+    memcpy(&_out[_offset], &_header, sizeof(_header));
+    _offset += sizeof(_header);
+    for (const vector<Order>* _stack : { &bidStack, &offerStack })
+    {
+        for (const Order& o : *_stack)
+        {
+            CompactOrder _order;
+            memset(&_order, 0, sizeof(_order));
+            _order.price = PriceToTicks(o.GetPrice());
+            _order.quantity = o.GetQuantity();
+            memcpy(&_out[_offset], &_order, sizeof(_order));
+            _offset += sizeof(_order);
+        }
+    }
+}
+
+template<typename T>
+OrderBook<T> OrderBook<T>::FromCompact(const char* _data, size_t _size)
+{
+    CompactOrderBook _header;
+    if (_size < sizeof(_header)) throw runtime_error("OrderBook: malformed compact book");
+    memcpy(&_header, _data, sizeof(_header));
+    if (_size != sizeof(_header) + (_header.bids + _header.offers) * sizeof(CompactOrder)) {
+        throw runtime_error("OrderBook: malformed compact book");
+    }
+
+    vector<Order> _stacks[2];
+    const char* _level = _data + sizeof(_header);
+    for (PricingSide _side : { BID, OFFER })
+    {
+        uint32_t _count = _side == BID ? _header.bids : _header.offers;
+        for (uint32_t i = 0; i < _count; i++, _level += sizeof(CompactOrder))
+        {
+            CompactOrder _order;
+            memcpy(&_order, _level, sizeof(_order));
+            _stacks[_side].emplace_back(TicksToPrice(_order.price), static_cast<long>(_order.quantity), _side);
+        }
+    }
+    return OrderBook<T>(RetrieveProductByHandle(_header.product), _stacks[BID], _stacks[OFFER]);
+}
+
 //get the best bid and offer
 template<typename T>
 const BidOffer OrderBook<T>::GetBidOffer() const {
@@ -195,7 +257,7 @@ class MarketDataService : public Service<string, OrderBook <T> >
 {
 
 private:
-    map<string, OrderBook<T>> orderBooks;
+    ProductMap<OrderBook<T>> orderBooks;
     vector<ServiceListener<OrderBook<T>>*> listeners;
     MarketDataConnector<T>* connector;
     int bookDepth;
@@ -203,7 +265,7 @@ private:
 public:
     // ctor
     MarketDataService(){
-        orderBooks = map<string, OrderBook<T>>();
+        orderBooks = ProductMap<OrderBook<T>>();
         listeners = vector<ServiceListener<OrderBook<T>>*>();
         connector = new MarketDataConnector<T>(this);
         bookDepth = 10;
@@ -220,9 +282,14 @@ public:
 
     // call back function for the connector
     void OnMessage(OrderBook<T>& _data) {
+        TRACE_SCOPE("MarketDataService::OnMessage");
+        TRACE_PRODUCT(_data.GetProduct());
+        this->metrics.CountIn();
         string product_id = _data.GetProduct().GetProductId();
         orderBooks[product_id] = _data;
+        this->metrics.SetStateSize(orderBooks.Size());
 
+        FanOutTimer _timer(this->metrics);
         for (auto& listener : listeners) {
             listener->ProcessAdd(_data);
         }
@@ -255,8 +322,43 @@ public:
 
     // Aggregate the order book
     const OrderBook<T>& AggregateDepth(const string& _id);
+
+    // Save the order books to a snapshot
+    void SaveSnapshot(SnapshotWriter& _writer);
+
+    // Restore the order books from a snapshot
+    void LoadSnapshot(SnapshotReader& _reader);
 };
 
+template<typename T>
+void MarketDataService<T>::SaveSnapshot(SnapshotWriter& _writer)
+{
+    _writer.BeginSection("BOOK");
+    _writer.Write(static_cast<uint64_t>(orderBooks.Size()));
+    vector<char> _book;
+    for (ProductHandle h : orderBooks.GetHandles())
+    {
+        _book.clear();
+        orderBooks[h].ToCompact(_book);
+        _writer.WriteVector(_book);
+    }
+}
+
+template<typename T>
+void MarketDataService<T>::LoadSnapshot(SnapshotReader& _reader)
+{
+    _reader.BeginSection("BOOK");
+    orderBooks.Clear();
+    uint64_t _count = _reader.Read<uint64_t>();
+    for (uint64_t i = 0; i < _count; i++)
+    {
+        vector<char> _book = _reader.ReadVector<char>();
+        OrderBook<T> _orderBook = OrderBook<T>::FromCompact(_book.data(), _book.size());
+        orderBooks[_orderBook.GetProduct().GetProductId()] = _orderBook;
+    }
+    this->metrics.SetStateSize(orderBooks.Size());
+}
+
 // Aggregate the order book
 template<typename T>
 const OrderBook<T>& MarketDataService<T>::AggregateDepth(const string& instrumentId) {
@@ -308,53 +410,85 @@ public:
     // ctor
     MarketDataConnector(MarketDataService<T>* _service){
         service = _service;
+        journal = nullptr;
     }
 
     // Publish data to the Connector
     void Publish(OrderBook<T>& _data){}
 
-    // Subscribe Ddata from the Connector
-    void Subscribe(ifstream& data);
+    // Flow every order record of a span into the Service; a book is sent once both its stacks are read
+    long ParseRecords(string_view records);
+
+    // Journal every accepted order book, nullptr to stop
+    void SetJournal(Journal* _journal) { journal = _journal; }
+
+private:
+    // Add one order record, split into tokens, to the book being read
+    void ProcessRecord();
+
+    Journal* journal;
+
+    // the book being read
+    long totalOrdersProcessed = 0;
+    vector<Order> bids;
+    vector<Order> offers;
+    vector<string_view> tokens;
 };
 
 template<typename T>
-void MarketDataConnector<T>::Subscribe(ifstream& marketDataStream)
+long MarketDataConnector<T>::ParseRecords(string_view records)
+{
+    long count = 0;
+    for (string_view record; NextRecord(records, record, tokens); ) {
+        try {
+            ProcessRecord();
+            count++;
+        }
+        catch (const exception& e) {
+            this->Reject(record, e);
+        }
+    }
+    this->metrics.CountIn(count);
+    return count;
+}
+
+template<typename T>
+void MarketDataConnector<T>::ProcessRecord()
 {
     // Processing data
+    TRACE_SCOPE("MarketDataConnector::ParseRecord");
     int depthOfBook = service->GetOrderBookDepth();
     int processThreshold = depthOfBook * 2;
-    long totalOrdersProcessed = 0;
-
-    vector<Order> bids;
-    vector<Order> offers;
-    string record;
 
-    while (getline(marketDataStream, record))
-    {
-        vector<string> tokens = SplitLine(record);
-        string productId = tokens[0];
-        double price = ConvertStringToPrice(tokens[1]);
-        long quantity = stol(tokens[2]);
+    if (tokens.size() < 4) throw invalid_argument("Malformed market data record");
+    string_view productId = tokens[0];
+    double price = ConvertStringToPrice(tokens[1]);
+    long quantity = ParseLong(tokens[2]);
 
-        PricingSide side = tokens[3] == "BID" ? BID : OFFER;
-        Order newOrder(price, quantity, side);
+    PricingSide side = tokens[3] == "BID" ? BID : OFFER;
+    Order newOrder(price, quantity, side);
 
-        if (side == BID) bids.push_back(newOrder);
-        else offers.push_back(newOrder);
+    if (side == BID) bids.push_back(newOrder);
+    else offers.push_back(newOrder);
 
-        totalOrdersProcessed++;
+    totalOrdersProcessed++;
 
-        // Trigger updates at specific intervals
-        if (totalOrdersProcessed % processThreshold == 0)
-        {
-            T product = RetrieveProduct(productId);
-            OrderBook<T> currentOrderBook(product, bids, offers);
-            service->OnMessage(currentOrderBook);
-
-            // Clearing the order stacks
-            bids.clear();
-            offers.clear();
+    // Trigger updates at specific intervals
+    if (totalOrdersProcessed % processThreshold == 0)
+    {
+        T product = RetrieveProduct(productId);
+        TRACE_PRODUCT(product);
+        OrderBook<T> currentOrderBook(product, bids, offers);
+        if (journal) {
+            vector<char> _book;
+            currentOrderBook.ToCompact(_book);
+            journal->Append(JOURNAL_ORDER_BOOK, _book.data(), _book.size());
         }
+        service->OnMessage(currentOrderBook);
+
+        // Clearing the order stacks
+        bids.clear();
+        offers.clear();
     }
 }
 
@@ -0,0 +1,360 @@
+/**
+ * metrics.hpp
+ * Defines the runtime counters of Services and Connectors, and two ways to read them while the system runs:
+ * a reporter writing a snapshot of every counter periodically, and a Unix-domain socket answering
+ * each connection with one.
+ * A counter is written by the one thread driving its Service at a time and read by any thread,
+ * so counting is a relaxed load and store, without a lock or a locked instruction.
+ *
+ * @author Lexie Zhu
+ */
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <sstream>
+#include <iomanip>
+#include <ostream>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#define METRICS_ENDPOINT 1
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#endif
+#include "utilities.hpp"
+
+using namespace std;
+
+/**
+ * Counter with one writer at a time and any number of readers.
+ */
+class Counter
+{
+
+public:
+
+    // ctor
+    Counter() : value(0) {}
+
+    // Add to the counter; only from the thread that owns it
+    void Add(int64_t _amount = 1) { value.store(value.load(memory_order_relaxed) + _amount, memory_order_relaxed); }
+
+    // Set the counter, for values such as sizes
+    void Set(int64_t _value) { value.store(_value, memory_order_relaxed); }
+
+    int64_t Get() const { return value.load(memory_order_relaxed); }
+
+private:
+    atomic<int64_t> value;
+};
+
+/**
+ * Counters of a Service or a Connector: messages in and out, time spent notifying listeners,
+ * the size of its state, and messages it dropped or throttled.
+ */
+class ServiceMetrics
+{
+
+public:
+
+    // Count messages taken in
+    void CountIn(int64_t _messages = 1) { in.Add(_messages); }
+
+    // Count messages handed on, to listeners or published
+    void CountOut(int64_t _messages = 1) { out.Add(_messages); }
+
+    // Add time spent notifying listeners
+    void AddFanOutTime(int64_t _nanoseconds) { fanOutNanoseconds.Add(_nanoseconds); }
+
+    // Set the number of entries held
+    void SetStateSize(size_t _size) { stateSize.Set(int64_t(_size)); }
+
+    // Count messages dropped, such as malformed records
+    void CountDropped(int64_t _messages = 1) { dropped.Add(_messages); }
+
+    // Count messages held back by throttling
+    void CountThrottled(int64_t _messages = 1) { throttled.Add(_messages); }
+
+    int64_t GetIn() const { return in.Get(); }
+    int64_t GetOut() const { return out.Get(); }
+    int64_t GetFanOutTime() const { return fanOutNanoseconds.Get(); }
+    int64_t GetStateSize() const { return stateSize.Get(); }
+    int64_t GetDropped() const { return dropped.Get(); }
+    int64_t GetThrottled() const { return throttled.Get(); }
+
+private:
+    Counter in;
+    Counter out;
+    Counter fanOutNanoseconds;
+    Counter stateSize;
+    Counter dropped;
+    Counter throttled;
+};
+
+/**
+ * Counts messages handed to the listeners of a Service and times the listeners until it goes out of scope.
+ */
+class FanOutTimer
+{
+
+public:
+
+    // ctor
+    FanOutTimer(ServiceMetrics& _metrics, int64_t _messages = 1) : metrics(_metrics), start(chrono::steady_clock::now())
+    {
+        metrics.CountOut(_messages);
+    }
+
+    ~FanOutTimer()
+    {
+        metrics.AddFanOutTime(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+    }
+
+    FanOutTimer(const FanOutTimer&) = delete;
+    FanOutTimer& operator=(const FanOutTimer&) = delete;
+
+private:
+    ServiceMetrics& metrics;
+    chrono::steady_clock::time_point start;
+};
+
+/**
+ * A value read from any thread when a snapshot is taken, such as the depth of a queue.
+ */
+struct Gauge
+{
+    string name;
+    function<int64_t()> read;
+};
+
+/**
+ * The counters reported, by name: those of Services and Connectors, and gauges read when a snapshot is taken,
+ * such as queue depths. Everything is registered before the reporter or the endpoint starts.
+ */
+class MetricsRegistry
+{
+
+public:
+
+    // ctor
+    MetricsRegistry() : last(chrono::steady_clock::now()) {}
+
+    // Report the counters of a Service or Connector under a name
+    void Add(const string& _name, const ServiceMetrics& _metrics) { sources.emplace_back(_name, &_metrics); }
+
+    // Report gauges under a name, on one line
+    void AddGauges(const string& _name, vector<Gauge> _gauges) { gauges.emplace_back(_name, move(_gauges)); }
+
+    // Take a snapshot of every counter, one line each; rates are over the time since the previous snapshot
+    string Snapshot();
+
+private:
+    vector<pair<string, const ServiceMetrics*>> sources;
+    vector<pair<string, vector<Gauge>>> gauges;
+
+    // counts in at the previous snapshot, for the rates
+    mutex lock;
+    chrono::steady_clock::time_point last;
+    map<string, int64_t> lastIn;
+};
+
+string MetricsRegistry::Snapshot()
+{
+    lock_guard<mutex> _guard(lock);
+    auto _now = chrono::steady_clock::now();
+    double _seconds = chrono::duration<double>(_now - last).count();
+    last = _now;
+
+    ostringstream _out;
+    _out << fixed << setprecision(0);
+    _out << "metrics " << GetTimeStamp() << "\n";
+    for (auto& s : sources) {
+        const ServiceMetrics& _metrics = *s.second;
+        int64_t _in = _metrics.GetIn();
+        int64_t& _previous = lastIn[s.first];
+        double _rate = _seconds > 0 ? (_in - _previous) / _seconds : 0;
+        _previous = _in;
+        _out << s.first << " in=" << _in << " rate=" << _rate << "/s out=" << _metrics.GetOut()
+             << " fanout_us=" << _metrics.GetFanOutTime() / 1000 << " size=" << _metrics.GetStateSize()
+             << " dropped=" << _metrics.GetDropped() << " throttled=" << _metrics.GetThrottled() << "\n";
+    }
+    for (auto& g : gauges) {
+        _out << g.first;
+        for (auto& _gauge : g.second) _out << " " << _gauge.name << "=" << _gauge.read();
+        _out << "\n";
+    }
+    return _out.str();
+}
+
+/**
+ * Thread writing a snapshot of the registry every period, and a last one when it stops.
+ */
+class MetricsReporter
+{
+
+public:
+
+    // ctor
+    MetricsReporter(MetricsRegistry& _registry, ostream& _out, chrono::milliseconds _period) :
+        registry(_registry), out(_out), period(_period), running(false) {}
+    ~MetricsReporter() { Stop(); }
+
+    void Start();
+
+    void Stop();
+
+private:
+    MetricsRegistry& registry;
+    ostream& out;
+    chrono::milliseconds period;
+    mutex lock;
+    condition_variable stopped;
+    bool running;
+    thread worker;
+};
+
+void MetricsReporter::Start()
+{
+    if (running) return;
+    running = true;
+    worker = thread([this]() {
+        unique_lock<mutex> _guard(lock);
+        while (!stopped.wait_for(_guard, period, [this]() { return !running; })) {
+            out << registry.Snapshot() << flush;
+        }
+    });
+}
+
+void MetricsReporter::Stop()
+{
+    {
+        lock_guard<mutex> _guard(lock);
+        if (!running) return;
+        running = false;
+    }
+    stopped.notify_all();
+    worker.join();
+    out << registry.Snapshot() << flush;
+}
+
+#ifdef METRICS_ENDPOINT
+
+/**
+ * Unix-domain socket answering every connection with a snapshot of the registry, then closing it,
+ * so the counters can be read on demand, e.g. with nc -U <path>.
+ */
+class MetricsEndpoint
+{
+
+public:
+
+    // ctor, listens on the socket path; throws runtime_error if it cannot
+    MetricsEndpoint(MetricsRegistry& _registry, const string& _path);
+    ~MetricsEndpoint();
+
+    MetricsEndpoint(const MetricsEndpoint&) = delete;
+    MetricsEndpoint& operator=(const MetricsEndpoint&) = delete;
+
+    // Start answering on a thread of its own
+    void Start();
+
+    void Stop();
+
+private:
+    // Answer one connection
+    void Answer(int _connection);
+
+    MetricsRegistry& registry;
+    string path;
+    int listener;
+    int wake[2];
+    thread worker;
+};
+
+MetricsEndpoint::MetricsEndpoint(MetricsRegistry& _registry, const string& _path) : registry(_registry), path(_path), listener(-1), wake{ -1, -1 }
+{
+    sockaddr_un _address;
+    memset(&_address, 0, sizeof(_address));
+    if (path.size() >= sizeof(_address.sun_path)) throw runtime_error("Socket path too long: " + path);
+    _address.sun_family = AF_UNIX;
+    strncpy(_address.sun_path, path.c_str(), sizeof(_address.sun_path) - 1);
+
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener < 0) throw runtime_error(string("metrics socket: ") + strerror(errno));
+    unlink(path.c_str());
+    if (bind(listener, reinterpret_cast<sockaddr*>(&_address), sizeof(_address)) < 0 || listen(listener, 4) < 0 || pipe(wake) < 0) {
+        string _error = "metrics socket " + path + ": " + strerror(errno);
+        close(listener);
+        throw runtime_error(_error);
+    }
+}
+
+MetricsEndpoint::~MetricsEndpoint()
+{
+    Stop();
+    close(listener);
+    close(wake[0]);
+    close(wake[1]);
+    unlink(path.c_str());
+}
+
+void MetricsEndpoint::Start()
+{
+    if (worker.joinable()) return;
+    worker = thread([this]() {
+        pollfd _watched[2] = { { listener, POLLIN, 0 }, { wake[0], POLLIN, 0 } };
+        while (true) {
+            if (poll(_watched, 2, -1) < 0) {
+                if (errno == EINTR) continue;
+                return;
+            }
+            if (_watched[1].revents) return;
+            if (_watched[0].revents & POLLIN) {
+                int _connection = accept(listener, nullptr, nullptr);
+                if (_connection >= 0) Answer(_connection);
+            }
+        }
+    });
+}
+
+void MetricsEndpoint::Stop()
+{
+    if (!worker.joinable()) return;
+    char _byte = 0;
+    while (write(wake[1], &_byte, 1) < 0 && errno == EINTR) {}
+    worker.join();
+}
+
+void MetricsEndpoint::Answer(int _connection)
+{
+    string _snapshot = registry.Snapshot();
+    for (size_t _written = 0; _written < _snapshot.size(); ) {
+        ssize_t _sent = send(_connection, _snapshot.data() + _written, _snapshot.size() - _written, MSG_NOSIGNAL);
+        if (_sent < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        _written += _sent;
+    }
+    close(_connection);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,274 @@
+/**
+ * placement.hpp
+ * Defines where the threads of the pipeline stages run.
+ * A placement configuration assigns each stage to cores and optionally a NUMA node; a stage's
+ * thread applies its placement when it starts and reports where it runs. With hot path isolation,
+ * the cores of the hot path stages are kept free of every other stage, such as the writers.
+ *
+ * @author Lexie Zhu
+ */
+#ifndef PLACEMENT_HPP
+#define PLACEMENT_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <stdexcept>
+#ifdef __linux__
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+using namespace std;
+
+// the pipeline stages; stages without a thread of their own run on the thread that feeds them
+const string STAGE_INGEST = "ingest";
+const string STAGE_ALGO_EXECUTION = "algo_execution";
+const string STAGE_BOOKING = "booking";
+const string STAGE_HISTORICAL = "historical";
+const string STAGE_GUI = "gui";
+const string STAGE_ANALYTICS = "analytics";
+
+// Parse a list of cpus such as "0-3,8", throws invalid_argument if malformed
+set<int> ParseCpuList(const string& _list)
+{
+    set<int> _cpus;
+    stringstream _stream(_list);
+    for (string _range; getline(_stream, _range, ','); )
+    {
+        size_t _dash = _range.find('-');
+        size_t _end;
+        int _first = stoi(_range, &_end);
+        int _last = _dash == string::npos ? _first : stoi(_range.substr(_dash + 1));
+        if (_first < 0 || _last < _first || (_dash == string::npos && _end != _range.size())) throw invalid_argument("bad cpu list " + _list);
+        for (int c = _first; c <= _last; c++) _cpus.insert(c);
+    }
+    return _cpus;
+}
+
+// Format a set of cpus as a list such as "0-3,8"
+string FormatCpuList(const set<int>& _cpus)
+{
+    string _list;
+    for (auto c = _cpus.begin(); c != _cpus.end(); )
+    {
+        int _first = *c, _last = *c;
+        while (++c != _cpus.end() && *c == _last + 1) _last = *c;
+        if (!_list.empty()) _list += ",";
+        _list += to_string(_first);
+        if (_last > _first) _list += "-" + to_string(_last);
+    }
+    return _list;
+}
+
+// Get the cpus of a NUMA node, empty if unknown
+set<int> NodeCpus(int _node)
+{
+    ifstream _file("/sys/devices/system/node/node" + to_string(_node) + "/cpulist");
+    string _list;
+    if (!getline(_file, _list) || _list.empty()) return set<int>();
+    return ParseCpuList(_list);
+}
+
+// Get the cpus online, whatever the affinity of the calling thread
+set<int> OnlineCpus()
+{
+    ifstream _file("/sys/devices/system/cpu/online");
+    string _list;
+    if (getline(_file, _list) && !_list.empty()) return ParseCpuList(_list);
+    set<int> _cpus;
+    for (unsigned c = 0; c < max(1u, thread::hardware_concurrency()); c++) _cpus.insert(c);
+    return _cpus;
+}
+
+/**
+ * Cores and NUMA node of a stage; no cpus means any, node -1 means any.
+ */
+struct ThreadPlacement
+{
+    set<int> cpus;
+    int node = -1;
+};
+
+/**
+ * Placement of the pipeline stages.
+ * A configuration file has one line per stage, "<stage> <cpus>|- [<node>]", and optionally
+ * "isolate <stage>,<stage>..." naming the hot path stages; '#' starts a comment.
+ */
+class PlacementConfig
+{
+
+public:
+
+    // Load a configuration file, throws runtime_error if it cannot be read or is malformed
+    void Load(const string& _path);
+
+    // Place a stage
+    void Set(const string& _stage, const ThreadPlacement& _placement);
+
+    // Keep the cores of these stages free of every other stage
+    void Isolate(const set<string>& _hotPath);
+
+    // Get the placement of a stage, false if it may run anywhere
+    bool Find(const string& _stage, ThreadPlacement& _placement) const;
+
+private:
+
+    // Get the cpus of the hot path stages
+    set<int> HotPathCpus() const;
+
+    map<string, ThreadPlacement> stages;
+    set<string> hotPath;
+};
+
+void PlacementConfig::Load(const string& _path)
+{
+    ifstream _file(_path);
+    if (!_file) throw runtime_error("Placement: cannot open " + _path);
+    string _line;
+    set<string> _hotPath;
+    for (int _number = 1; getline(_file, _line); _number++)
+    {
+        _line = _line.substr(0, _line.find('#'));
+        stringstream _stream(_line);
+        string _stage, _cpus, _node;
+        if (!(_stream >> _stage)) continue;
+        try {
+            if (!(_stream >> _cpus)) throw invalid_argument("expected cpus");
+            if (_stage == "isolate") {
+                stringstream _names(_cpus);
+                for (string _name; getline(_names, _name, ','); ) _hotPath.insert(_name);
+                continue;
+            }
+            ThreadPlacement _placement;
+            if (_cpus != "-") _placement.cpus = ParseCpuList(_cpus);
+            if (_stream >> _node) _placement.node = stoi(_node);
+            Set(_stage, _placement);
+        }
+        catch (const exception& e) {
+            throw runtime_error("Placement: " + _path + " line " + to_string(_number) + ": " + e.what());
+        }
+    }
+    Isolate(_hotPath);
+}
+
+void PlacementConfig::Set(const string& _stage, const ThreadPlacement& _placement)
+{
+    stages[_stage] = _placement;
+}
+
+void PlacementConfig::Isolate(const set<string>& _hotPath)
+{
+    hotPath = _hotPath;
+    set<int> _hotCpus = HotPathCpus();
+    for (auto& s : stages) {
+        if (hotPath.count(s.first)) continue;
+        for (int c : s.second.cpus) {
+            if (_hotCpus.count(c)) throw runtime_error("Placement: " + s.first + " shares cpu " + to_string(c) + " with the hot path");
+        }
+    }
+}
+
+set<int> PlacementConfig::HotPathCpus() const
+{
+    set<int> _cpus;
+    for (auto& s : hotPath) {
+        auto _it = stages.find(s);
+        if (_it == stages.end() || _it->second.cpus.empty()) throw runtime_error("Placement: hot path stage " + s + " has no cpus");
+        _cpus.insert(_it->second.cpus.begin(), _it->second.cpus.end());
+    }
+    return _cpus;
+}
+
+bool PlacementConfig::Find(const string& _stage, ThreadPlacement& _placement) const
+{
+    bool _hot = hotPath.count(_stage) > 0;
+    auto _it = stages.find(_stage);
+    if (_it == stages.end() && (hotPath.empty() || _hot)) return false;
+
+    _placement = _it != stages.end() ? _it->second : ThreadPlacement();
+    bool _listed = !_placement.cpus.empty();
+    if (_placement.node >= 0) {
+        // the node's cpus, or those of the listed cpus on the node
+        set<int> _nodeCpus = NodeCpus(_placement.node);
+        if (!_listed) _placement.cpus = _nodeCpus;
+        else if (!_nodeCpus.empty()) {
+            set<int> _both;
+            for (int c : _placement.cpus) if (_nodeCpus.count(c)) _both.insert(c);
+            _placement.cpus = _both;
+        }
+    }
+    else if (!_listed && !hotPath.empty()) {
+        _placement.cpus = OnlineCpus();
+    }
+
+    // with isolation, a stage without cpus of its own runs on the cores the hot path does not use
+    if (!_listed && !_hot) {
+        for (int c : HotPathCpus()) _placement.cpus.erase(c);
+    }
+    return !_placement.cpus.empty() || _placement.node >= 0;
+}
+
+// Get the placement configuration of the process
+PlacementConfig& ThreadPlacements()
+{
+    static PlacementConfig config;
+    return config;
+}
+
+/**
+ * Place the calling thread as configured for its stage and report where it runs.
+ * Memory is preferred from the stage's node, so what the thread allocates stays local.
+ * Returns false if the placement could not be applied.
+ */
+bool PlaceThread(const string& _stage)
+{
+    static mutex reportLock;
+    ThreadPlacement _placement;
+    bool _placed = ThreadPlacements().Find(_stage, _placement);
+    bool _applied = true;
+    string _report;
+#ifdef __linux__
+    if (_placed && !_placement.cpus.empty()) {
+        cpu_set_t _set;
+        CPU_ZERO(&_set);
+        for (int c : _placement.cpus) CPU_SET(c, &_set);
+        _applied = pthread_setaffinity_np(pthread_self(), sizeof(_set), &_set) == 0;
+    }
+    if (_placed && _placement.node >= 0 && _placement.node < 64) {
+        // MPOL_PREFERRED, without depending on libnuma
+        unsigned long _mask = 1UL << _placement.node;
+        _applied = syscall(SYS_set_mempolicy, 1, &_mask, sizeof(_mask) * 8) == 0 && _applied;
+    }
+
+    // report what the thread actually got
+    set<int> _cpus;
+    cpu_set_t _set;
+    if (pthread_getaffinity_np(pthread_self(), sizeof(_set), &_set) == 0) {
+        for (int c = 0; c < CPU_SETSIZE; c++) {
+            if (CPU_ISSET(c, &_set)) _cpus.insert(c);
+        }
+    }
+    _report = "thread " + to_string(syscall(SYS_gettid)) + " on cpus " + FormatCpuList(_cpus);
+#else
+    _applied = !_placed;
+    _report = "placement not supported on this platform";
+#endif
+    if (_placed && _placement.node >= 0) _report += ", node " + to_string(_placement.node);
+    if (!_placed) _report += " (unpinned)";
+    if (!_applied) _report += " (placement failed)";
+
+    lock_guard<mutex> _guard(reportLock);
+    std::cout << "Stage " << _stage << ": " << _report << std::endl;
+    return _applied;
+}
+
+#endif
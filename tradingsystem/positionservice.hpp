@@ -11,6 +11,7 @@
 #include <map>
 #include "soa.hpp"
 #include "tradebookingservice.hpp"
+#include "snapshot.hpp"
 
 using namespace std;
 
@@ -131,7 +132,7 @@ class PositionService : public Service<string, Position <T> >
 public:
     // Ctor
     PositionService(){
-        positions = map<string, Position<T>>();
+        positions = ProductMap<Position<T>>();
         listeners = vector<ServiceListener<Position<T>>*>();
         listener = new PositionToTradeBookingListener<T>(this);
     };
@@ -143,8 +144,12 @@ public:
 
     // Callback for any new or updated data
     void OnMessage(Position<T>& _data){
+        TRACE_SCOPE("PositionService::OnMessage");
+        TRACE_PRODUCT(_data.GetProduct());
+        this->metrics.CountIn();
         string _id = _data.GetProduct().GetProductId();
         positions[_id] = _data;
+        this->metrics.SetStateSize(positions.Size());
     };
 
     // Add a listener to the Service for callbacks on add, remove, and update events for data to the Service
@@ -165,8 +170,14 @@ public:
     // Add a trade to the service
     virtual void AddTrade(const Trade<T>& _trade);
 
+    // Save the positions to a snapshot
+    void SaveSnapshot(SnapshotWriter& _writer);
+
+    // Restore the positions from a snapshot
+    void LoadSnapshot(SnapshotReader& _reader);
+
 private:
-    map<string, Position<T>> positions;
+    ProductMap<Position<T>> positions;
     vector<ServiceListener<Position<T>>*> listeners;
     PositionToTradeBookingListener<T>* listener;
 };
@@ -176,6 +187,7 @@ private:
 template<typename T>
 void PositionService<T>::AddTrade(const Trade<T>& _trade)
 {
+    this->metrics.CountIn();
     T _product = _trade.GetProduct();
     string _productId = _product.GetProductId();
     double _price = _trade.GetPrice();
@@ -193,7 +205,7 @@ void PositionService<T>::AddTrade(const Trade<T>& _trade)
     }
 
     // update the book
-    Position<T> _positionFrom = positions[_productId];
+    Position<T>& _positionFrom = positions[_productId];
     map <string, long> _positionMap = _positionFrom.GetPositions();
     for (auto& p : _positionMap)
     {
@@ -201,15 +213,56 @@ void PositionService<T>::AddTrade(const Trade<T>& _trade)
         _quantity = p.second;
         _positionTo.AddPosition(_book, _quantity);
     }
-    positions[_productId] = _positionTo;
+    _positionFrom = _positionTo;
+    this->metrics.SetStateSize(positions.Size());
 
     // add back into the system.
+    FanOutTimer _timer(this->metrics);
     for (auto& l : listeners)
     {
         l->ProcessAdd(_positionTo);
     }
 }
 
+template<typename T>
+void PositionService<T>::SaveSnapshot(SnapshotWriter& _writer)
+{
+    _writer.BeginSection("POSN");
+    _writer.Write(static_cast<uint64_t>(positions.Size()));
+    for (ProductHandle h : positions.GetHandles())
+    {
+        map<string, long> _books = positions[h].GetPositions();
+        _writer.Write(h);
+        _writer.Write(static_cast<uint32_t>(_books.size()));
+        for (auto& b : _books)
+        {
+            _writer.WriteString(b.first);
+            _writer.Write(static_cast<int64_t>(b.second));
+        }
+    }
+}
+
+template<typename T>
+void PositionService<T>::LoadSnapshot(SnapshotReader& _reader)
+{
+    _reader.BeginSection("POSN");
+    positions.Clear();
+    uint64_t _count = _reader.Read<uint64_t>();
+    for (uint64_t i = 0; i < _count; i++)
+    {
+        T _product = RetrieveProductByHandle(_reader.Read<ProductHandle>());
+        Position<T> _position(_product);
+        uint32_t _books = _reader.Read<uint32_t>();
+        for (uint32_t b = 0; b < _books; b++)
+        {
+            string _book = _reader.ReadString();
+            _position.AddPosition(_book, static_cast<long>(_reader.Read<int64_t>()));
+        }
+        positions[_product.GetProductId()] = _position;
+    }
+    this->metrics.SetStateSize(positions.Size());
+}
+
 /**
 * Position Service Listener subscribing data from trading_booking_service to position_service.
 */
@@ -230,6 +283,8 @@ public:
 
     // Process an add event to the Service
     void ProcessAdd(Trade<T>& _data){
+        TRACE_SCOPE("PositionToTradeBookingListener::ProcessAdd");
+        TRACE_PRODUCT(_data.GetProduct());
         service->AddTrade(_data);
     };
 
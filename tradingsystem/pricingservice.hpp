@@ -10,6 +10,8 @@
 #include "utilities.hpp"
 #include <string>
 #include "soa.hpp"
+#include "compactmessages.hpp"
+#include "journal.hpp"
 
 /**
  * A price object consisting of mid and bid/offer spread.
@@ -35,6 +37,10 @@ public:
 
     // Change attributes to strings
     vector<string> ToStrings() const;
+
+    // Convert to and from the fixed layout
+    CompactPrice ToCompact() const;
+    static Price<T> FromCompact(const CompactPrice& _compact);
 private:
 
     T product;
@@ -83,6 +89,23 @@ vector<string> Price<T>::ToStrings() const
     return _strings;
 }
 
+template<typename T>
+CompactPrice Price<T>::ToCompact() const
+{
+    CompactPrice _compact;
+    memset(&_compact, 0, sizeof(_compact));
+    _compact.product = GetProductHandle(product.GetProductId());
+    _compact.mid = PriceToTicks(mid);
+    _compact.bidOfferSpread = PriceToTicks(bidOfferSpread);
+    return _compact;
+}
+
+template<typename T>
+Price<T> Price<T>::FromCompact(const CompactPrice& _compact)
+{
+    return Price<T>(RetrieveProductByHandle(_compact.product), TicksToPrice(_compact.mid), TicksToPrice(_compact.bidOfferSpread));
+}
+
 /**
 * Pre-declearations
 */
@@ -98,14 +121,14 @@ template<typename T>
 class PricingService : public Service<string, Price <T> >
 {
 private:
-    map<string, Price<T>> prices;
+    ProductMap<Price<T>> prices;
     vector<ServiceListener<Price<T>>*> listeners;
     PricingConnector<T>* connector;
 public:
     //Ctor and Dtor
     PricingService()
     {
-        prices = map<string, Price<T>>();
+        prices = ProductMap<Price<T>>();
         listeners = vector<ServiceListener<Price<T>>*>();
         connector = new PricingConnector<T>(this);
     }
@@ -118,13 +141,33 @@ public:
 
     // Callback for any new or updated data
     void OnMessage(Price<T>& _data){
+        TRACE_SCOPE("PricingService::OnMessage");
+        TRACE_PRODUCT(_data.GetProduct());
+        this->metrics.CountIn();
         prices[_data.GetProduct().GetProductId()] = _data;
+        this->metrics.SetStateSize(prices.Size());
 
+        FanOutTimer _timer(this->metrics);
         for (auto& listener : listeners) {
             listener->ProcessAdd(_data);
         }
     };
 
+    // Callback for a run of new or updated data; each listener takes the whole run at once
+    void OnMessageBatch(Span<Price<T>> _data){
+        TRACE_SCOPE("PricingService::OnMessageBatch");
+        this->metrics.CountIn(_data.size());
+        for (auto& d : _data) {
+            prices[d.GetProduct().GetProductId()] = d;
+        }
+        this->metrics.SetStateSize(prices.Size());
+
+        FanOutTimer _timer(this->metrics, _data.size());
+        for (auto& listener : listeners) {
+            listener->ProcessAddBatch(_data);
+        }
+    };
+
     // Add a listener to the Service for callbacks on add, remove, and update events for data to the Service
     void AddListener(ServiceListener<Price<T>>* _listener){
         listeners.push_back(_listener);
@@ -154,41 +197,96 @@ public:
     // Ctor
     PricingConnector(PricingService<T>* _service){
         service = _service;
+        journal = nullptr;
     };
 
     // Publish data to the Connector
     void Publish(Price<T>& _data) {};
 
-    // Subscribe data from the Connector
-    void Subscribe(ifstream& _data);
+    // Flow every price record of a span into the Service
+    long ParseRecords(string_view _span);
+
+    // Journal every accepted price, nullptr to stop
+    void SetJournal(Journal* _journal) { journal = _journal; }
+
+    // Set the largest batch of prices handed to the Service at once, 1 for one at a time
+    void SetMaxBatchSize(size_t _max) { batchSize.SetMax(_max); }
 
 private:
+    // Add one price record, split into cells, to the batch
+    void ProcessRecord();
+
+    // Hand the batch to the Service
+    void FlushBatch();
+
     PricingService<T>* service;
+    Journal* journal;
+    vector<string_view> cells;
+    vector<Price<T>> batch;
+    AdaptiveBatchSize batchSize;
 };
 
-// Core function: reading from "data.txt"
+// Core function: reading the records of "prices.txt"
 // and process the data.
 template<typename T>
-void PricingConnector<T>::Subscribe(ifstream& _data)
+long PricingConnector<T>::ParseRecords(string_view _span)
 {
-    string line;
-    while (getline(_data, line))
-    {
-        auto cells = SplitLine(line);
-
-        // fetch the corresponding data features
-        string _productId = cells[0];
-        double bid_price = ConvertStringToPrice(cells[1]);
-        double offer_price = ConvertStringToPrice(cells[2]);
-        double mid_price = (bid_price + offer_price) / 2.0;
-        double spread = offer_price - bid_price;
-        T _product = RetrieveProduct(_productId);
+    long _count = 0;
+    for (string_view _record; NextRecord(_span, _record, cells); ) {
+        try {
+            ProcessRecord();
+            _count++;
+        }
+        catch (const exception& e) {
+            this->Reject(_record, e);
+        }
 
-        Price<T> _price(_product, mid_price, spread);
+        // a full batch with more records behind it means the feed is ahead of us: the next one may be larger
+        if (batch.size() >= batchSize.Get()) {
+            FlushBatch();
+            if (!_span.empty()) batchSize.Filled();
+        }
+    }
 
-        // update the generated price Data to the service.
-        service->OnMessage(_price);
+    // nothing more to read, so nothing waits for a batch to fill
+    if (!batch.empty()) {
+        FlushBatch();
+        batchSize.Drained();
     }
+    this->metrics.CountIn(_count);
+    return _count;
+}
+
+template<typename T>
+void PricingConnector<T>::FlushBatch()
+{
+    if (batch.size() == 1) service->OnMessage(batch.front());
+    else service->OnMessageBatch(Span<Price<T>>(batch));
+    batch.clear();
+}
+
+template<typename T>
+void PricingConnector<T>::ProcessRecord()
+{
+    TRACE_SCOPE("PricingConnector::ParseRecord");
+    if (cells.size() < 3) throw invalid_argument("Malformed price record");
+
+    // fetch the corresponding data features
+    string_view _productId = cells[0];
+    double bid_price = ConvertStringToPrice(cells[1]);
+    double offer_price = ConvertStringToPrice(cells[2]);
+    double mid_price = (bid_price + offer_price) / 2.0;
+    double spread = offer_price - bid_price;
+    T _product = RetrieveProduct(_productId);
+    TRACE_PRODUCT(_product);
+
+    Price<T> _price(_product, mid_price, spread);
+
+    // journal it before the service sees it
+    if (journal) journal->Append(JOURNAL_PRICE, _price.ToCompact());
+
+    // the service gets it with the rest of the batch
+    batch.push_back(_price);
 }
 
 
@@ -0,0 +1,254 @@
+/**
+ * productregistry.hpp
+ * Defines the registry of tradable products and their compact handles.
+ * The registry starts with the compiled-in reference data and can load more securities
+ * from a reference data file at startup. A handle is the product's position in the registry;
+ * compiled-in CUSIPs resolve through the perfect hash, loaded ones through a hash index.
+ * Services keep their per-product state in a ProductMap indexed by handle.
+ *
+ * @author Lexie Zhu
+ */
+#ifndef PRODUCT_REGISTRY_HPP
+#define PRODUCT_REGISTRY_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <cstdio>
+#include "products.hpp"
+#include "hashindex.hpp"
+#include "referencedata_generated.hpp"
+#include <boost/date_time/gregorian/gregorian.hpp>
+
+using namespace std;
+using namespace boost::gregorian;
+
+// Compact handle of a product: its position in the registry
+typedef uint32_t ProductHandle;
+
+// Index of a CUSIP in the reference data, -1 if unknown;
+// computed at compile time when the id is a constant
+constexpr int FindReferenceIndex(string_view _id) {
+    return PerfectHashFind(_id, REFERENCE_DISPLACEMENTS, REFERENCE_SLOTS, REFERENCE_BONDS);
+}
+
+static_assert(FindReferenceIndex(REFERENCE_BONDS[0].cusip) == 0, "reference data perfect hash");
+
+/**
+ * Registry of the products the system trades, with their reference data.
+ * Products are only added at startup, before the services run, so lookups take no lock.
+ * Products are kept in a deque, so references to them stay valid as securities are added.
+ */
+class ProductRegistry
+{
+
+public:
+
+    // Get the registry of the process
+    static ProductRegistry& Instance();
+
+    // Add a security, or update it if the CUSIP is known, and get its handle
+    ProductHandle Add(const Bond& _bond, int _maturityYears, double _pv01);
+
+    // Load the securities of a reference data file, in the format of referencedata.csv;
+    // gets the number of securities read, throws runtime_error on a malformed line
+    size_t Load(const string& _path);
+    size_t Load(istream& _file);
+
+    // Find the handle of a CUSIP, false if unknown
+    bool Find(string_view _id, ProductHandle& _handle) const;
+
+    // Get the product of a handle, throws out_of_range if there is none
+    const Bond& Get(ProductHandle _handle) const { return products.at(_handle); }
+
+    // Get the PV01 of a handle
+    double GetPV01(ProductHandle _handle) const { return pv01s.at(_handle); }
+
+    // Get the maturity in years of a handle
+    int GetMaturityYears(ProductHandle _handle) const { return maturities.at(_handle); }
+
+    // Get the number of products
+    size_t Size() const { return products.size(); }
+
+private:
+
+    // ctor, seeded with the compiled-in reference data so handles match its order
+    ProductRegistry();
+
+    deque<Bond> products;
+    vector<double> pv01s;
+    vector<int> maturities;
+    OpenAddressingIndex index;
+};
+
+ProductRegistry& ProductRegistry::Instance()
+{
+    static ProductRegistry registry;
+    return registry;
+}
+
+ProductRegistry::ProductRegistry()
+{
+    for (const ReferenceBond& r : REFERENCE_BONDS) {
+        Add(Bond(r.cusip, CUSIP, r.ticker, r.coupon, date(r.maturityYear, r.maturityMonth, r.maturityDay)), r.maturityYears, r.pv01);
+    }
+}
+
+ProductHandle ProductRegistry::Add(const Bond& _bond, int _maturityYears, double _pv01)
+{
+    ProductHandle _handle;
+    // while seeding, compiled-in CUSIPs are found before they are added
+    if (Find(_bond.GetProductId(), _handle) && _handle < products.size()) {
+        products[_handle] = _bond;
+        pv01s[_handle] = _pv01;
+        maturities[_handle] = _maturityYears;
+        return _handle;
+    }
+
+    _handle = static_cast<ProductHandle>(products.size());
+    products.push_back(_bond);
+    pv01s.push_back(_pv01);
+    maturities.push_back(_maturityYears);
+    // compiled-in securities are found through the perfect hash
+    if (_handle >= REFERENCE_BOND_COUNT) index.Insert(_bond.GetProductId(), _handle);
+    return _handle;
+}
+
+bool ProductRegistry::Find(string_view _id, ProductHandle& _handle) const
+{
+    int _reference = FindReferenceIndex(_id);
+    if (_reference >= 0) {
+        _handle = static_cast<ProductHandle>(_reference);
+        return true;
+    }
+    return index.Find(_id, _handle);
+}
+
+size_t ProductRegistry::Load(const string& _path)
+{
+    ifstream _file(_path);
+    if (!_file) throw runtime_error("ProductRegistry: cannot open " + _path);
+    try {
+        return Load(_file);
+    }
+    catch (const runtime_error& e) {
+        throw runtime_error(_path + ": " + e.what());
+    }
+}
+
+size_t ProductRegistry::Load(istream& _file)
+{
+    size_t _count = 0;
+    string _line;
+    for (int _number = 1; getline(_file, _line); _number++)
+    {
+        if (!_line.empty() && _line.back() == '\r') _line.pop_back();
+        if (_line.empty() || _line[0] == '#' || _line.rfind("cusip,", 0) == 0) continue;
+
+        // cusip,ticker,maturity_years,coupon,maturity_date(YYYY-MM-DD),pv01
+        vector<string> _cells;
+        stringstream _stream(_line);
+        for (string _cell; getline(_stream, _cell, ','); ) _cells.push_back(_cell);
+
+        try {
+            if (_cells.size() != 6) throw invalid_argument("expected 6 columns");
+            int _year, _month, _day;
+            if (sscanf(_cells[4].c_str(), "%d-%d-%d", &_year, &_month, &_day) != 3) throw invalid_argument("bad maturity date");
+            Bond _bond(_cells[0], CUSIP, _cells[1], stod(_cells[3]), date(_year, _month, _day));
+            Add(_bond, stoi(_cells[2]), stod(_cells[5]));
+        }
+        catch (const exception& e) {
+            throw runtime_error("line " + to_string(_number) + ": " + e.what());
+        }
+        _count++;
+    }
+    return _count;
+}
+
+/**
+ * State of a Service keyed by product, stored in a vector indexed by product handle.
+ * A lookup by id costs one hash of the id and one indexed load, and a lookup by handle only the load,
+ * whatever the number of products; the values of products never seen are default-constructed.
+ */
+template<typename V>
+class ProductMap
+{
+
+public:
+
+    // Get the value of a product, added on first access; throws out_of_range if the product is unknown
+    V& operator[](string_view _productId) { return (*this)[Handle(_productId)]; }
+    V& operator[](ProductHandle _handle);
+
+    // Find the value of a product, nullptr if it has none
+    V* Find(string_view _productId);
+    V* Find(ProductHandle _handle) { return _handle < held.size() && held[_handle] ? &values[_handle] : nullptr; }
+    const V* Find(string_view _productId) const { return const_cast<ProductMap*>(this)->Find(_productId); }
+    const V* Find(ProductHandle _handle) const { return const_cast<ProductMap*>(this)->Find(_handle); }
+
+    // Get the handles of the products held, in the order they were added
+    const vector<ProductHandle>& GetHandles() const { return handles; }
+
+    // Get the number of products held
+    size_t Size() const { return handles.size(); }
+
+    // Remove every value
+    void Clear();
+
+private:
+
+    // Get the handle of a product id, throws out_of_range if unknown
+    static ProductHandle Handle(string_view _productId);
+
+    vector<V> values;
+    vector<bool> held;
+    vector<ProductHandle> handles;
+};
+
+template<typename V>
+V& ProductMap<V>::operator[](ProductHandle _handle)
+{
+    if (_handle >= values.size()) {
+        // products are only added at startup, so this resizes once
+        size_t _size = max(size_t(_handle) + 1, ProductRegistry::Instance().Size());
+        values.resize(_size);
+        held.resize(_size, false);
+    }
+    if (!held[_handle]) {
+        held[_handle] = true;
+        handles.push_back(_handle);
+    }
+    return values[_handle];
+}
+
+template<typename V>
+V* ProductMap<V>::Find(string_view _productId)
+{
+    ProductHandle _handle;
+    return ProductRegistry::Instance().Find(_productId, _handle) ? Find(_handle) : nullptr;
+}
+
+template<typename V>
+void ProductMap<V>::Clear()
+{
+    for (ProductHandle h : handles) {
+        values[h] = V();
+        held[h] = false;
+    }
+    handles.clear();
+}
+
+template<typename V>
+ProductHandle ProductMap<V>::Handle(string_view _productId)
+{
+    ProductHandle _handle;
+    if (!ProductRegistry::Instance().Find(_productId, _handle)) throw out_of_range("Unknown CUSIP " + string(_productId));
+    return _handle;
+}
+
+#endif
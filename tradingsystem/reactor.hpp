@@ -0,0 +1,343 @@
+/**
+ * reactor.hpp
+ * Defines a single-threaded epoll reactor driving Connectors from live feed sources.
+ * A feed listens on a Unix-domain socket, a TCP port or a named pipe; its publisher connects
+ * or opens the pipe for writing and streams newline-terminated records, as in the data files.
+ * Each connection is an FdSource reading straight into a buffer reused for the whole feed, and
+ * the complete records of every read are handed to the Connector's ParseRecords in place.
+ * The reactor needs Linux epoll; elsewhere only the file feeds are available.
+ *
+ * @author Lexie Zhu
+ */
+#ifndef REACTOR_HPP
+#define REACTOR_HPP
+
+#ifdef __linux__
+#define FEED_REACTOR 1
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <unistd.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include "soa.hpp"
+#include "bytesource.hpp"
+#include "utilities.hpp"
+
+using namespace std;
+
+// bytes a feed buffer starts with; it doubles whenever one record does not fit
+const size_t FEED_BUFFER_SIZE = 65536;
+
+enum EndpointType { ENDPOINT_UNIX, ENDPOINT_TCP, ENDPOINT_FIFO };
+
+/**
+ * Where a feed is published: unix:<path>, tcp:[<host>:]<port> or fifo:<path>.
+ * A TCP feed without a host listens on the loopback interface only.
+ */
+struct FeedEndpoint
+{
+    EndpointType type;
+    string path;
+    string host;
+    int port;
+};
+
+// Parse an endpoint, throws invalid_argument if malformed
+FeedEndpoint ParseEndpoint(const string& _endpoint)
+{
+    size_t _colon = _endpoint.find(':');
+    string _scheme = _endpoint.substr(0, _colon);
+    string _address = _colon == string::npos ? string() : _endpoint.substr(_colon + 1);
+    if (_address.empty()) throw invalid_argument("Malformed endpoint " + _endpoint);
+
+    FeedEndpoint _parsed{ ENDPOINT_UNIX, "", "127.0.0.1", 0 };
+    if (_scheme == "unix" || _scheme == "fifo") {
+        _parsed.type = _scheme == "unix" ? ENDPOINT_UNIX : ENDPOINT_FIFO;
+        _parsed.path = _address;
+        if (_parsed.type == ENDPOINT_UNIX && _parsed.path.size() >= sizeof(sockaddr_un::sun_path))
+            throw invalid_argument("Socket path too long in " + _endpoint);
+        return _parsed;
+    }
+    if (_scheme == "tcp") {
+        _parsed.type = ENDPOINT_TCP;
+        size_t _port = _address.rfind(':');
+        if (_port != string::npos) {
+            _parsed.host = _address.substr(0, _port);
+            _address = _address.substr(_port + 1);
+        }
+        try {
+            size_t _end;
+            _parsed.port = stoi(_address, &_end);
+            if (_end != _address.size() || _parsed.port <= 0 || _parsed.port > 65535) throw invalid_argument(_address);
+        }
+        catch (const exception&) {
+            throw invalid_argument("Malformed port in " + _endpoint);
+        }
+        return _parsed;
+    }
+    throw invalid_argument("Unknown endpoint type in " + _endpoint);
+}
+
+// Fill in the socket address of a Unix or TCP endpoint, returns its length; throws runtime_error if the host is unknown
+socklen_t EndpointAddress(const FeedEndpoint& _endpoint, sockaddr_storage& _address)
+{
+    memset(&_address, 0, sizeof(_address));
+    if (_endpoint.type == ENDPOINT_UNIX) {
+        sockaddr_un* _unix = reinterpret_cast<sockaddr_un*>(&_address);
+        _unix->sun_family = AF_UNIX;
+        strncpy(_unix->sun_path, _endpoint.path.c_str(), sizeof(_unix->sun_path) - 1);
+        return sizeof(sockaddr_un);
+    }
+
+    addrinfo _hints{};
+    _hints.ai_family = AF_INET;
+    _hints.ai_socktype = SOCK_STREAM;
+    addrinfo* _found = nullptr;
+    if (getaddrinfo(_endpoint.host.c_str(), nullptr, &_hints, &_found) != 0 || !_found)
+        throw runtime_error("Unknown host " + _endpoint.host);
+    sockaddr_in* _inet = reinterpret_cast<sockaddr_in*>(&_address);
+    *_inet = *reinterpret_cast<sockaddr_in*>(_found->ai_addr);
+    _inet->sin_port = htons(_endpoint.port);
+    freeaddrinfo(_found);
+    return sizeof(sockaddr_in);
+}
+
+/**
+ * Reactor reading every feed on the calling thread, whichever has data first.
+ * A socket feed takes one publisher connection; a feed ends when its publisher disconnects
+ * or closes the pipe, and Run returns once every feed has ended.
+ * Records the Connector rejects are counted and skipped. A tick runs on the same thread at a steady period,
+ * whether or not any feed has data, for work that is due on time rather than on the next record.
+ */
+class FeedReactor
+{
+
+public:
+
+    // ctor
+    FeedReactor(size_t _bufferSize = FEED_BUFFER_SIZE);
+    ~FeedReactor();
+
+    // Listen for a feed under a name and drive a Connector with its records; throws runtime_error if the endpoint cannot be opened
+    template<typename V>
+    void AddFeed(const string& _name, const string& _endpoint, Connector<V>* _connector);
+
+    // Call _tick every _periodMs while Run runs, on its thread
+    void SetTick(function<void()> _tick, int _periodMs) { tick = _tick; tickPeriod = max(_periodMs, 1); }
+
+    // Run every feed to its end, returns the number of records accepted
+    long Run();
+
+    // Get the number of records accepted from a feed
+    long GetRecords(const string& _name) const;
+
+    // Get the number of records of a feed its Connector rejected
+    long GetRejected(const string& _name) const;
+
+private:
+
+    struct Feed
+    {
+        string name;
+        FeedEndpoint endpoint;
+        int listener;
+        unique_ptr<FdSource> source;
+        function<long(string_view)> parse;
+        function<void()> end;
+        function<long()> rejected;
+        long records;
+        bool ended;
+    };
+
+    // Open a feed's endpoint and watch it for its publisher
+    void Add(const string& _name, const FeedEndpoint& _endpoint, function<long(string_view)> _parse, function<void()> _end, function<long()> _rejected);
+
+    // Take a publisher connection off a listening socket
+    void Accept(Feed& _feed);
+
+    // Read what a connection has and hand over its complete records
+    void Read(Feed& _feed);
+
+    // End a feed once its publisher is gone
+    void Finish(Feed& _feed);
+
+    const Feed* Find(const string& _name) const;
+
+    int epoll;
+    size_t bufferSize;
+    vector<unique_ptr<Feed>> feeds;
+    int open;
+    function<void()> tick;
+    int tickPeriod;
+};
+
+FeedReactor::FeedReactor(size_t _bufferSize) : epoll(epoll_create1(EPOLL_CLOEXEC)), bufferSize(max(_bufferSize, size_t(1))), open(0), tickPeriod(0)
+{
+    if (epoll < 0) throw runtime_error(SystemError("epoll_create1"));
+}
+
+FeedReactor::~FeedReactor()
+{
+    for (auto& f : feeds) {
+        if (f->listener >= 0) close(f->listener);
+        if (f->endpoint.type == ENDPOINT_UNIX) unlink(f->endpoint.path.c_str());
+    }
+    close(epoll);
+}
+
+template<typename V>
+void FeedReactor::AddFeed(const string& _name, const string& _endpoint, Connector<V>* _connector)
+{
+    long _rejectedBefore = _connector->GetRejectedCount();
+    Add(_name, ParseEndpoint(_endpoint),
+        [_connector](string_view _records) { return _connector->ParseRecords(_records); },
+        [_connector]() { _connector->EndOfFeed(); },
+        [_connector, _rejectedBefore]() { return _connector->GetRejectedCount() - _rejectedBefore; });
+}
+
+void FeedReactor::Add(const string& _name, const FeedEndpoint& _endpoint, function<long(string_view)> _parse, function<void()> _end, function<long()> _rejected)
+{
+    unique_ptr<Feed> _feed(new Feed{ _name, _endpoint, -1, nullptr, move(_parse), move(_end), move(_rejected), 0, false });
+    int _fd;
+    if (_endpoint.type == ENDPOINT_FIFO) {
+        // opened without blocking, the pipe only reports its end once a writer has come and gone
+        if (mkfifo(_endpoint.path.c_str(), 0600) < 0 && errno != EEXIST) throw runtime_error(SystemError("mkfifo " + _endpoint.path));
+        _fd = ::open(_endpoint.path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (_fd < 0) throw runtime_error(SystemError("open " + _endpoint.path));
+        _feed->source.reset(new FdSource(_fd, bufferSize));
+    }
+    else {
+        sockaddr_storage _address;
+        socklen_t _length = EndpointAddress(_endpoint, _address);
+        _fd = socket(_address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (_fd < 0) throw runtime_error(SystemError("socket"));
+        int _reuse = 1;
+        if (_endpoint.type == ENDPOINT_UNIX) unlink(_endpoint.path.c_str());
+        else setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &_reuse, sizeof(_reuse));
+        if (::bind(_fd, reinterpret_cast<sockaddr*>(&_address), _length) < 0 || listen(_fd, 1) < 0) {
+            string _error = SystemError("listen on " + _name + " feed");
+            close(_fd);
+            throw runtime_error(_error);
+        }
+        _feed->listener = _fd;
+    }
+
+    epoll_event _event{};
+    _event.events = EPOLLIN;
+    _event.data.ptr = _feed.get();
+    if (epoll_ctl(epoll, EPOLL_CTL_ADD, _fd, &_event) < 0) throw runtime_error(SystemError("epoll_ctl"));
+    feeds.push_back(move(_feed));
+    open++;
+}
+
+long FeedReactor::Run()
+{
+    vector<epoll_event> _events(max(feeds.size(), size_t(1)));
+    auto _nextTick = chrono::steady_clock::now() + chrono::milliseconds(tickPeriod);
+    while (open > 0) {
+        int _ready = epoll_wait(epoll, _events.data(), int(_events.size()), tick ? tickPeriod : -1);
+        if (_ready < 0) {
+            if (errno == EINTR) continue;
+            throw runtime_error(SystemError("epoll_wait"));
+        }
+        if (tick && chrono::steady_clock::now() >= _nextTick) {
+            tick();
+            _nextTick = chrono::steady_clock::now() + chrono::milliseconds(tickPeriod);
+        }
+        for (int i = 0; i < _ready; i++) {
+            Feed& _feed = *static_cast<Feed*>(_events[i].data.ptr);
+            if (_feed.ended) continue;
+            if (!_feed.source) Accept(_feed);
+            else Read(_feed);
+        }
+    }
+
+    long _total = 0;
+    for (auto& f : feeds) _total += f->records;
+    return _total;
+}
+
+void FeedReactor::Accept(Feed& _feed)
+{
+    int _fd = accept4(_feed.listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (_fd < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNABORTED) return;
+        throw runtime_error(SystemError("accept on " + _feed.name + " feed"));
+    }
+
+    // one publisher per feed; stop listening once it is connected
+    close(_feed.listener);
+    _feed.listener = -1;
+    if (_feed.endpoint.type == ENDPOINT_UNIX) unlink(_feed.endpoint.path.c_str());
+    _feed.source.reset(new FdSource(_fd, bufferSize));
+    epoll_event _event{};
+    _event.events = EPOLLIN;
+    _event.data.ptr = &_feed;
+    if (epoll_ctl(epoll, EPOLL_CTL_ADD, _fd, &_event) < 0) throw runtime_error(SystemError("epoll_ctl"));
+    std::cout << GetTimeStamp() << " Feed " << _feed.name << " connected." << std::endl;
+}
+
+void FeedReactor::Read(Feed& _feed)
+{
+    // one read per wake-up, so a busy feed cannot starve the others
+    string_view _records;
+    try {
+        if (!_feed.source->Next(_records)) {
+            Finish(_feed);
+            return;
+        }
+    }
+    catch (const exception& e) {
+        std::cerr << "Feed " << _feed.name << ": " << e.what() << std::endl;
+        Finish(_feed);
+        return;
+    }
+    if (!_records.empty()) _feed.records += _feed.parse(_records);
+}
+
+void FeedReactor::Finish(Feed& _feed)
+{
+    _feed.source.reset();
+    _feed.ended = true;
+    _feed.end();
+    open--;
+    std::cout << GetTimeStamp() << " Feed " << _feed.name << " ended after " << _feed.records << " records ("
+              << _feed.rejected() << " rejected)." << std::endl;
+}
+
+const FeedReactor::Feed* FeedReactor::Find(const string& _name) const
+{
+    for (auto& f : feeds) {
+        if (f->name == _name) return f.get();
+    }
+    return nullptr;
+}
+
+long FeedReactor::GetRecords(const string& _name) const
+{
+    const Feed* _feed = Find(_name);
+    return _feed ? _feed->records : 0;
+}
+
+long FeedReactor::GetRejected(const string& _name) const
+{
+    const Feed* _feed = Find(_name);
+    return _feed ? _feed->rejected() : 0;
+}
+
+#endif
+#endif
@@ -0,0 +1,153 @@
+/** Generates the constexpr reference data tables from a reference data file.
+* Usage: refdatagen referencedata.csv > referencedata_generated.hpp
+* Each line of the file is cusip,ticker,maturity_years,coupon,maturity_date(YYYY-MM-DD),pv01;
+* blank lines, lines starting with # and the column header are skipped.
+* Compile it with: g++ -std=c++17 refdatagen.cpp -o refdatagen
+* @author: Lexie Zhu
+*/
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include "referencehash.hpp"
+
+// a security as read, numbers kept as written so the tables hold the exact source values
+struct Security
+{
+    string cusip;
+    string ticker;
+    string maturityYears;
+    string coupon;
+    int year, month, day;
+    string pv01;
+};
+
+// the largest displacement tried for a bucket before giving up
+const uint32_t MAX_DISPLACEMENT = 1u << 24;
+
+vector<Security> ReadSecurities(istream& _file)
+{
+    vector<Security> _securities;
+    set<string> _cusips;
+    string _line;
+    for (int _number = 1; getline(_file, _line); _number++)
+    {
+        if (!_line.empty() && _line.back() == '\r') _line.pop_back();
+        if (_line.empty() || _line[0] == '#' || _line.rfind("cusip,", 0) == 0) continue;
+
+        vector<string> _cells;
+        stringstream _stream(_line);
+        for (string _cell; getline(_stream, _cell, ','); ) _cells.push_back(_cell);
+
+        Security _security;
+        try {
+            if (_cells.size() != 6) throw invalid_argument("expected 6 columns");
+            _security.cusip = _cells[0];
+            _security.ticker = _cells[1];
+            _security.maturityYears = to_string(stoi(_cells[2]));
+            _security.coupon = _cells[3];
+            _security.pv01 = _cells[5];
+            stod(_security.coupon);
+            stod(_security.pv01);
+            if (sscanf(_cells[4].c_str(), "%d-%d-%d", &_security.year, &_security.month, &_security.day) != 3) throw invalid_argument("bad maturity date");
+            if (!_cusips.insert(_security.cusip).second) throw invalid_argument("duplicate cusip");
+        }
+        catch (const exception& e) {
+            throw runtime_error("line " + to_string(_number) + ": " + e.what());
+        }
+        _securities.push_back(_security);
+    }
+    return _securities;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        std::cerr << "Usage: " << argv[0] << " <referencedata.csv>" << std::endl;
+        return 1;
+    }
+    ifstream file(argv[1]);
+    if (!file) {
+        std::cerr << "Cannot open " << argv[1] << std::endl;
+        return 1;
+    }
+
+    vector<Security> securities;
+    try {
+        securities = ReadSecurities(file);
+    }
+    catch (const exception& e) {
+        std::cerr << argv[1] << ": " << e.what() << std::endl;
+        return 1;
+    }
+    if (securities.empty()) {
+        std::cerr << argv[1] << ": no securities" << std::endl;
+        return 1;
+    }
+
+    // about four ids per bucket, and slots at 80% load
+    size_t n = securities.size();
+    size_t bucketCount = (n + 3) / 4;
+    size_t slotCount = n + n / 4 + 1;
+
+    vector<vector<int>> buckets(bucketCount);
+    for (size_t i = 0; i < n; i++) {
+        buckets[ReferenceHash(securities[i].cusip, 0) % bucketCount].push_back(static_cast<int>(i));
+    }
+
+    // place the largest buckets first, while most slots are free
+    vector<size_t> order(bucketCount);
+    for (size_t b = 0; b < bucketCount; b++) order[b] = b;
+    stable_sort(order.begin(), order.end(), [&](size_t x, size_t y) { return buckets[x].size() > buckets[y].size(); });
+
+    vector<uint32_t> displacements(bucketCount, 0);
+    vector<int32_t> slots(slotCount, -1);
+    for (size_t b : order)
+    {
+        if (buckets[b].empty()) continue;
+        uint32_t d = 1;
+        vector<size_t> placed;
+        for (; d < MAX_DISPLACEMENT; d++)
+        {
+            placed.clear();
+            bool fits = true;
+            for (int i : buckets[b]) {
+                size_t s = ReferenceHash(securities[i].cusip, d) % slotCount;
+                if (slots[s] >= 0 || find(placed.begin(), placed.end(), s) != placed.end()) {
+                    fits = false;
+                    break;
+                }
+                placed.push_back(s);
+            }
+            if (fits) break;
+        }
+        if (d == MAX_DISPLACEMENT) {
+            std::cerr << "No perfect hash found" << std::endl;
+            return 1;
+        }
+        displacements[b] = d;
+        for (size_t k = 0; k < placed.size(); k++) slots[placed[k]] = buckets[b][k];
+    }
+
+    std::cout << "/**\n"
+              << " * referencedata_generated.hpp\n"
+              << " * Generated by refdatagen from " << argv[1] << "; do not edit.\n"
+              << " */\n"
+              << "#ifndef REFERENCE_DATA_GENERATED_HPP\n"
+              << "#define REFERENCE_DATA_GENERATED_HPP\n\n"
+              << "#include \"referencehash.hpp\"\n\n"
+              << "constexpr size_t REFERENCE_BOND_COUNT = " << n << ";\n\n"
+              << "constexpr ReferenceBond REFERENCE_BONDS[] = {\n";
+    for (auto& s : securities) {
+        std::cout << "    { \"" << s.cusip << "\", \"" << s.ticker << "\", " << s.maturityYears << ", " << s.coupon << ", "
+                  << s.year << ", " << s.month << ", " << s.day << ", " << s.pv01 << " },\n";
+    }
+    std::cout << "};\n\n" << "constexpr uint32_t REFERENCE_DISPLACEMENTS[] = {";
+    for (size_t b = 0; b < bucketCount; b++) std::cout << (b % 16 ? " " : "\n    ") << displacements[b] << ",";
+    std::cout << "\n};\n\n" << "constexpr int32_t REFERENCE_SLOTS[] = {";
+    for (size_t s = 0; s < slotCount; s++) std::cout << (s % 16 ? " " : "\n    ") << slots[s] << ",";
+    std::cout << "\n};\n\n" << "#endif\n";
+    return 0;
+}
@@ -0,0 +1,30 @@
+/**
+ * referencedata_generated.hpp
+ * Generated by refdatagen from referencedata.csv; do not edit.
+ */
+#ifndef REFERENCE_DATA_GENERATED_HPP
+#define REFERENCE_DATA_GENERATED_HPP
+
+#include "referencehash.hpp"
+
+constexpr size_t REFERENCE_BOND_COUNT = 7;
+
+constexpr ReferenceBond REFERENCE_BONDS[] = {
+    { "91282CJL6", "US2Y", 2, 0.04875, 2025, 11, 30, 0.01967211 },
+    { "91282CHY0", "US3Y", 3, 0.04625, 2026, 9, 15, 0.028849852 },
+    { "91282CHX2", "US5Y", 5, 0.04375, 2028, 8, 31, 0.048555605 },
+    { "91282CJM4", "US7Y", 7, 0.04375, 2030, 11, 30, 0.068303332 },
+    { "91282CJJ1", "US10Y", 10, 0.04500, 2033, 11, 15, 0.08071955 },
+    { "912810TM0", "US20Y", 20, 0.04000, 2042, 11, 30, 0.118325668 },
+    { "912810TL2", "US30Y", 30, 0.04000, 2052, 11, 15, 0.185319634 },
+};
+
+constexpr uint32_t REFERENCE_DISPLACEMENTS[] = {
+    7, 4,
+};
+
+constexpr int32_t REFERENCE_SLOTS[] = {
+    -1, -1, 0, 5, 6, 1, 4, 2, 3,
+};
+
+#endif
@@ -0,0 +1,57 @@
+/**
+ * referencehash.hpp
+ * Defines the layout of the generated reference data tables and their perfect hash.
+ * refdatagen builds the tables at build time with hash-and-displace: every id is put in a
+ * bucket by one hash, and each bucket gets a displacement seed sending all of its ids to
+ * free slots, so a lookup is two hashes and one comparison, and can run at compile time.
+ *
+ * @author Lexie Zhu
+ */
+#ifndef REFERENCE_HASH_HPP
+#define REFERENCE_HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+using namespace std;
+
+/**
+ * A security of the reference data.
+ */
+struct ReferenceBond
+{
+    const char* cusip;
+    const char* ticker;
+    int maturityYears;
+    double coupon;
+    int maturityYear;
+    int maturityMonth;
+    int maturityDay;
+    double pv01;
+};
+
+// FNV-1a of the id from a seeded basis, then mixed so every bit reaches the low bits
+constexpr uint64_t ReferenceHash(string_view _id, uint64_t _seed)
+{
+    uint64_t _hash = 14695981039346656037ULL ^ (_seed * 0x9E3779B97F4A7C15ULL);
+    for (char c : _id) {
+        _hash ^= static_cast<unsigned char>(c);
+        _hash *= 1099511628211ULL;
+    }
+    _hash ^= _hash >> 32;
+    _hash *= 0xD6E8FEB86659FD93ULL;
+    _hash ^= _hash >> 32;
+    return _hash;
+}
+
+// Index of _id in _bonds, -1 if it is not there
+template<size_t B, size_t S, size_t N>
+constexpr int PerfectHashFind(string_view _id, const uint32_t (&_displacements)[B], const int32_t (&_slots)[S], const ReferenceBond (&_bonds)[N])
+{
+    uint32_t _displacement = _displacements[ReferenceHash(_id, 0) % B];
+    int32_t _index = _slots[ReferenceHash(_id, _displacement) % S];
+    return _index >= 0 && string_view(_bonds[_index].cusip) == _id ? _index : -1;
+}
+
+#endif
@@ -10,6 +10,8 @@
 #include "soa.hpp"
 #include "positionservice.hpp"
 #include "utilities.hpp"
+#include "compactmessages.hpp"
+#include "snapshot.hpp"
 
 /**
  * PV01 risk.
@@ -17,6 +19,7 @@
  */
 #include <string>
 #include <vector>
+#include <algorithm>
 using namespace std;
 
 template<typename T>
@@ -50,6 +53,20 @@ public:
         };
     }
 
+    // Convert to and from the fixed layout
+    CompactPV01 ToCompact() const {
+        CompactPV01 _compact;
+        memset(&_compact, 0, sizeof(_compact));
+        _compact.product = GetProductHandle(product.GetProductId());
+        _compact.pv01 = pv01;
+        _compact.quantity = quantity;
+        return _compact;
+    }
+
+    static PV01<T> FromCompact(const CompactPV01& _compact) {
+        return PV01<T>(RetrieveProductByHandle(_compact.product), _compact.pv01, _compact.quantity);
+    }
+
 private:
     T product;
     double pv01;
@@ -101,7 +118,9 @@ class RiskService : public Service<string, PV01 <T> >
 public:
 
     // ctor
-    RiskService() : pv01s(), listeners(), listener(new RiskToPositionListener<T>(this)) {}
+    RiskService() : pv01s(), listeners(), listener(new RiskToPositionListener<T>(this)),
+                    conflate(false), flushCount(0), flushInterval(0), pendingUpdates(0), conflatedCount(0),
+                    lastFlush(ClockNow()) {}
 
     // Add a position
     void AddPosition(Position<T>& position);
@@ -124,34 +143,147 @@ public:
     //Get the listener specific to the risk position
     RiskToPositionListener<T>* GetListener() { return listener; }
 
+    // Conflate publication to the listeners: only the latest PV01 per product is kept
+    // and published once _count updates are pending or _intervalMs has elapsed,
+    // checked as updates arrive. GetData always returns the exact current value.
+    void SetConflation(long _count, long _intervalMs);
+
+    // Publish the latest PV01 of every product updated since the last flush
+    void Flush();
+
+    // Flush once the interval has elapsed; call it periodically, as updates alone leave a quiet product unpublished
+    void FlushIfDue();
+
+    // Get the number of PV01 updates superseded before publication
+    long GetConflatedCount() const { return conflatedCount; }
+
+    // Save the PV01s to a snapshot
+    void SaveSnapshot(SnapshotWriter& _writer);
+
+    // Restore the PV01s from a snapshot
+    void LoadSnapshot(SnapshotReader& _reader);
+
 private:
-    map<string, PV01<T>> pv01s;
+    ProductMap<PV01<T>> pv01s;
     vector<ServiceListener<PV01<T>>*> listeners;
     RiskToPositionListener<T>* listener;
+
+    // conflation state
+    bool conflate;
+    long flushCount;
+    int64_t flushInterval; // nanoseconds of the clock in use
+    ProductMap<char> pending; // products updated since the last flush
+    long pendingUpdates;
+    long conflatedCount;
+    int64_t lastFlush;
 };
 
 template<typename T>
 void RiskService<T>::OnMessage(PV01<T>& _data)
 {
+    TRACE_SCOPE("RiskService::OnMessage");
+    TRACE_PRODUCT(_data.GetProduct());
+    this->metrics.CountIn();
     string id = _data.GetProduct().GetProductId();
     pv01s[id] = _data;
+    this->metrics.SetStateSize(pv01s.Size());
 }
 
 // add position, in connection with the Position class
 template<typename T>
 void RiskService<T>::AddPosition(Position<T>& _position)
 {
+    this->metrics.CountIn();
     T _product = _position.GetProduct();
-    string _id = _product.GetProductId();
-    double _pv01Value = GetPV01(_id); //utility function
+    ProductHandle _handle = GetProductHandle(_product.GetProductId());
+    double _pv01Value = ProductRegistry::Instance().GetPV01(_handle);
     long _quantity = _position.GetAggregatePosition();
     PV01<T> _pv01(_product, _pv01Value, _quantity);
-    pv01s[_id] = _pv01;
+    pv01s[_handle] = _pv01;
+    this->metrics.SetStateSize(pv01s.Size());
+
+    if (!conflate)
+    {
+        FanOutTimer _timer(this->metrics);
+        for (auto& l : listeners)
+        {
+            l->ProcessAdd(_pv01);
+        }
+        return;
+    }
+
+    // keep the latest value only, publish on the count or time boundary
+    char& _pending = pending[_handle];
+    if (_pending) {
+        conflatedCount++;
+        this->metrics.CountThrottled();
+    }
+    _pending = true;
+    pendingUpdates++;
+    if (pendingUpdates >= flushCount) Flush();
+    else FlushIfDue();
+}
+
+template<typename T>
+void RiskService<T>::SetConflation(long _count, long _intervalMs)
+{
+    Flush();
+    conflate = true;
+    flushCount = _count;
+    flushInterval = _intervalMs * 1000000;
+}
+
+template<typename T>
+void RiskService<T>::FlushIfDue()
+{
+    if (conflate && pendingUpdates > 0 && ClockNow() - lastFlush >= flushInterval) Flush();
+}
+
+template<typename T>
+void RiskService<T>::Flush()
+{
+    // publish in product id order, as a set of ids would
+    vector<ProductHandle> _handles = pending.GetHandles();
+    sort(_handles.begin(), _handles.end(), [](ProductHandle a, ProductHandle b) {
+        return RetrieveProductByHandle(a).GetProductId() < RetrieveProductByHandle(b).GetProductId();
+    });
+    FanOutTimer _timer(this->metrics, _handles.size());
+    for (ProductHandle h : _handles)
+    {
+        PV01<T>& _pv01 = pv01s[h];
+        for (auto& l : listeners)
+        {
+            l->ProcessAdd(_pv01);
+        }
+    }
+    pending.Clear();
+    pendingUpdates = 0;
+    lastFlush = ClockNow();
+}
+
+template<typename T>
+void RiskService<T>::SaveSnapshot(SnapshotWriter& _writer)
+{
+    vector<CompactPV01> _pv01s;
+    for (ProductHandle h : pv01s.GetHandles())
+    {
+        _pv01s.push_back(pv01s[h].ToCompact());
+    }
+    _writer.BeginSection("RISK");
+    _writer.WriteVector(_pv01s);
+}
 
-    for (auto& l : listeners)
+template<typename T>
+void RiskService<T>::LoadSnapshot(SnapshotReader& _reader)
+{
+    _reader.BeginSection("RISK");
+    pv01s.Clear();
+    for (auto& c : _reader.ReadVector<CompactPV01>())
     {
-        l->ProcessAdd(_pv01);
+        PV01<T> _pv01 = PV01<T>::FromCompact(c);
+        pv01s[_pv01.GetProduct().GetProductId()] = _pv01;
     }
+    this->metrics.SetStateSize(pv01s.Size());
 }
 
 template<typename T>
@@ -189,7 +321,11 @@ public:
     RiskToPositionListener(RiskService<T>* _service) : service(_service) {}
 
     // Listener callback to process an add event to the Service
-    void ProcessAdd(Position<T>& data) { service->AddPosition(data); }
+    void ProcessAdd(Position<T>& data) {
+        TRACE_SCOPE("RiskToPositionListener::ProcessAdd");
+        TRACE_PRODUCT(data.GetProduct());
+        service->AddPosition(data);
+    }
 
     // ProcessRemove and ProcessUpdate do nothing
     void ProcessRemove(Position<T>& data) {}
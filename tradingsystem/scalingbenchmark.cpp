@@ -0,0 +1,133 @@
+/** Measures the per-message cost of the services as the number of securities grows.
+* Usage: scalingbenchmark [<messages per feed>]
+* For each universe size, synthetic securities are added to the product registry, the services
+* are built and linked as in main.cpp, and prices, order books, trades and inquiries spread
+* over all the products are sent straight to the services; no files are parsed.
+* Historical data is written to the working directory, so run it in a scratch directory.
+* Compile it like main.cpp: g++ -std=c++17 -O2 scalingbenchmark.cpp -o scalingbenchmark
+* @author: Lexie Zhu
+*/
+#include <iostream>
+#include <iomanip>
+#include "products.hpp"
+#include "algoexecutionservice.hpp"
+#include "algostreamingservice.hpp"
+#include "analyticsservice.hpp"
+#include "executionservice.hpp"
+#include "GUIservice.hpp"
+#include "historicaldataservice.hpp"
+#include "inquiryservice.hpp"
+#include "marketdataservice.hpp"
+#include "positionservice.hpp"
+#include "pricingservice.hpp"
+#include "riskservice.hpp"
+#include "streamingservice.hpp"
+#include "tradebookingservice.hpp"
+#include "utilities.hpp"
+
+// Add synthetic securities until the registry holds _count products
+void GrowUniverse(size_t _count)
+{
+    ProductRegistry& registry = ProductRegistry::Instance();
+    const int maturities[] = { 2, 3, 5, 7, 10, 20, 30 };
+    for (size_t i = registry.Size(); i < _count; i++) {
+        char cusip[32];
+        snprintf(cusip, sizeof(cusip), "9S%07zu", i);
+        int years = maturities[i % 7];
+        registry.Add(Bond(cusip, CUSIP, "SYN", 0.04, date(2024 + years, 1, 15)), years, 0.01 * years);
+    }
+}
+
+// Time a feed, in nanoseconds per message
+template<typename F>
+double TimePerMessage(size_t _messages, F _feed)
+{
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < _messages; i++) _feed(i);
+    auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+    return double(elapsed) / _messages;
+}
+
+int main(int argc, char* argv[]) {
+    size_t messages = argc > 1 ? stoul(argv[1]) : 20000;
+    const size_t universes[] = { 7, 100, 1000, 10000 };
+    const double mintick = 1.0 / 256.0;
+
+    std::cout << setw(10) << "products" << setw(12) << "price" << setw(12) << "orderbook"
+              << setw(12) << "trade" << setw(12) << "inquiry" << "   (ns per message)" << std::endl;
+    for (size_t universe : universes)
+    {
+        GrowUniverse(universe);
+
+        // the messages are built up front, products drawn uniformly from the universe
+        mt19937_64 gen(universe);
+        uniform_int_distribution<size_t> pick(0, universe - 1);
+        vector<Price<Bond>> prices;
+        vector<OrderBook<Bond>> books;
+        vector<Trade<Bond>> trades;
+        vector<Inquiry<Bond>> inquiries;
+        for (size_t i = 0; i < messages; i++) {
+            double mid = 99.0 + mintick * (gen() % 512);
+            prices.emplace_back(RetrieveProductByHandle(pick(gen)), mid, mintick * (2 + i % 3));
+
+            vector<Order> bids, offers;
+            for (int level = 0; level < 5; level++) {
+                bids.emplace_back(mid - mintick * (level + 1), 10000000 * (level + 1), BID);
+                offers.emplace_back(mid + mintick * (level + 1), 10000000 * (level + 1), OFFER);
+            }
+            books.emplace_back(RetrieveProductByHandle(pick(gen)), bids, offers);
+
+            trades.emplace_back(RetrieveProductByHandle(pick(gen)), "TRD" + GenerateTradingId(9), mid,
+                "TRSY" + to_string(i % 3 + 1), 1000000 * (i % 5 + 1), i % 2 ? BUY : SELL);
+            inquiries.emplace_back("INQ" + GenerateTradingId(9), RetrieveProductByHandle(pick(gen)),
+                i % 2 ? BUY : SELL, 1000000 * (i % 5 + 1), mid, RECEIVED);
+        }
+
+        MarketDataService<Bond> BondMarketDataService;
+        PricingService<Bond> BondPricingService;
+        TradeBookingService<Bond> BondTradeBookingService;
+        PositionService<Bond> BondPositionService;
+        RiskService<Bond> BondRiskService;
+        AlgoExecutionService<Bond> BondAlgoExecutionService;
+        AlgoStreamingService<Bond> BondAlgoStreamingService;
+        ExecutionService<Bond> BondExecutionService;
+        StreamingService<Bond> BondStreamingService;
+        InquiryService<Bond> BondInquiryService;
+        GUIService<Bond> BondGUIService;
+        AnalyticsService<Bond> BondAnalyticsService;
+        HistoricalDataService<Position<Bond>> histPositionService(POSITION);
+        HistoricalDataService<PV01<Bond>> histRiskService(RISK);
+        HistoricalDataService<ExecutionOrder<Bond>> histExecutionService(EXECUTION);
+        HistoricalDataService<PriceStream<Bond>> histStreamingService(STREAMING);
+        HistoricalDataService<Inquiry<Bond>> histInquiryService(INQUIRY);
+
+        // linked as in main.cpp, with algo execution listening to market data directly
+        BondPricingService.AddListener(BondGUIService.GetListener());
+        BondPricingService.AddListener(BondAlgoStreamingService.GetListener());
+        BondAlgoStreamingService.AddListener(BondStreamingService.GetListener());
+        BondPricingService.AddListener(BondAnalyticsService.GetListener());
+        BondStreamingService.AddListener(histStreamingService.GetServiceListener());
+        BondMarketDataService.AddListener(BondAlgoExecutionService.GetListener());
+        BondAlgoExecutionService.AddListener(BondExecutionService.GetListener());
+        BondExecutionService.AddListener(histExecutionService.GetServiceListener());
+        BondExecutionService.AddListener(BondTradeBookingService.GetListener());
+        BondTradeBookingService.AddListener(BondPositionService.GetListener());
+        BondPositionService.AddListener(BondRiskService.GetListener());
+        BondPositionService.AddListener(histPositionService.GetServiceListener());
+        BondRiskService.AddListener(histRiskService.GetServiceListener());
+        BondRiskService.SetConflation(1000, 500);
+        BondInquiryService.AddListener(histInquiryService.GetServiceListener());
+        BondPricingService.AddListener(BondInquiryService.GetPricingListener());
+
+        double priceCost = TimePerMessage(messages, [&](size_t i) { BondPricingService.OnMessage(prices[i]); });
+        double bookCost = TimePerMessage(messages, [&](size_t i) { BondMarketDataService.OnMessage(books[i]); });
+        double tradeCost = TimePerMessage(messages, [&](size_t i) { BondTradeBookingService.OnMessage(trades[i]); });
+        BondRiskService.Flush();
+        double inquiryCost = TimePerMessage(messages, [&](size_t i) { BondInquiryService.OnMessage(inquiries[i]); });
+        BondInquiryService.ProcessPendingInquiries();
+
+        std::cout << fixed << setprecision(0) << setw(10) << universe << setw(12) << priceCost << setw(12) << bookCost
+                  << setw(12) << tradeCost << setw(12) << inquiryCost << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,180 @@
+/**
+ * snapshot.hpp
+ * Defines the binary snapshot writer and reader services use to save and restore their state.
+ * A snapshot is a sequence of tagged sections; it is written to a temporary file
+ * and renamed into place on Commit(), so a crash never leaves a partial snapshot behind.
+ *
+ * @author Lexie Zhu
+ */
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <cstdio>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <type_traits>
+
+using namespace std;
+
+const uint32_t SNAPSHOT_MAGIC = 0x50414E53; // "SNAP"
+const uint32_t SNAPSHOT_VERSION = 4;
+
+/**
+ * Writer of a binary snapshot.
+ */
+class SnapshotWriter
+{
+
+public:
+
+    // ctor, opens the temporary file next to _path
+    SnapshotWriter(const string& _path);
+
+    // Start a section, tags are four characters
+    void BeginSection(const char* _tag);
+
+    // Write a trivially copyable value
+    template<typename P>
+    void Write(const P& _value);
+
+    // Write a length-prefixed string
+    void WriteString(const string& _value);
+
+    // Write a length-prefixed vector of trivially copyable values
+    template<typename P>
+    void WriteVector(const vector<P>& _values);
+
+    // Flush and move the snapshot into place
+    void Commit();
+
+private:
+    string path;
+    string tempPath;
+    ofstream file;
+};
+
+SnapshotWriter::SnapshotWriter(const string& _path) : path(_path), tempPath(_path + ".tmp")
+{
+    file.open(tempPath, ios::binary | ios::trunc);
+    if (!file) throw runtime_error("Snapshot: cannot open " + tempPath);
+    Write(SNAPSHOT_MAGIC);
+    Write(SNAPSHOT_VERSION);
+}
+
+void SnapshotWriter::BeginSection(const char* _tag)
+{
+    file.write(_tag, 4);
+}
+
+template<typename P>
+void SnapshotWriter::Write(const P& _value)
+{
+    static_assert(is_trivially_copyable<P>::value, "snapshot values must be trivially copyable");
+    file.write(reinterpret_cast<const char*>(&_value), sizeof(P));
+}
+
+void SnapshotWriter::WriteString(const string& _value)
+{
+    Write(static_cast<uint32_t>(_value.size()));
+    file.write(_value.data(), _value.size());
+}
+
+template<typename P>
+void SnapshotWriter::WriteVector(const vector<P>& _values)
+{
+    static_assert(is_trivially_copyable<P>::value, "snapshot values must be trivially copyable");
+    Write(static_cast<uint64_t>(_values.size()));
+    file.write(reinterpret_cast<const char*>(_values.data()), _values.size() * sizeof(P));
+}
+
+void SnapshotWriter::Commit()
+{
+    file.flush();
+    if (!file) throw runtime_error("Snapshot: write failed on " + tempPath);
+    file.close();
+    if (rename(tempPath.c_str(), path.c_str()) != 0) throw runtime_error("Snapshot: cannot rename to " + path);
+}
+
+/**
+ * Reader of a binary snapshot; throws on a malformed or truncated file.
+ */
+class SnapshotReader
+{
+
+public:
+
+    // ctor, opens and validates the header
+    SnapshotReader(const string& _path);
+
+    // Expect the next section to carry _tag
+    void BeginSection(const char* _tag);
+
+    // Read a trivially copyable value
+    template<typename P>
+    P Read();
+
+    // Read a length-prefixed string
+    string ReadString();
+
+    // Read a length-prefixed vector of trivially copyable values
+    template<typename P>
+    vector<P> ReadVector();
+
+private:
+
+    // Read raw bytes
+    void ReadBytes(char* _out, size_t _size);
+
+    ifstream file;
+};
+
+SnapshotReader::SnapshotReader(const string& _path)
+{
+    file.open(_path, ios::binary);
+    if (!file) throw runtime_error("Snapshot: cannot open " + _path);
+    if (Read<uint32_t>() != SNAPSHOT_MAGIC) throw runtime_error("Snapshot: not a snapshot " + _path);
+    if (Read<uint32_t>() != SNAPSHOT_VERSION) throw runtime_error("Snapshot: unsupported version in " + _path);
+}
+
+void SnapshotReader::ReadBytes(char* _out, size_t _size)
+{
+    file.read(_out, _size);
+    if (static_cast<size_t>(file.gcount()) != _size) throw runtime_error("Snapshot: truncated");
+}
+
+void SnapshotReader::BeginSection(const char* _tag)
+{
+    char _read[4];
+    ReadBytes(_read, 4);
+    if (string(_read, 4) != string(_tag, 4)) throw runtime_error("Snapshot: expected section " + string(_tag, 4));
+}
+
+template<typename P>
+P SnapshotReader::Read()
+{
+    static_assert(is_trivially_copyable<P>::value, "snapshot values must be trivially copyable");
+    P _value;
+    ReadBytes(reinterpret_cast<char*>(&_value), sizeof(P));
+    return _value;
+}
+
+string SnapshotReader::ReadString()
+{
+    string _value(Read<uint32_t>(), '\0');
+    ReadBytes(&_value[0], _value.size());
+    return _value;
+}
+
+template<typename P>
+vector<P> SnapshotReader::ReadVector()
+{
+    static_assert(is_trivially_copyable<P>::value, "snapshot values must be trivially copyable");
+    vector<P> _values(Read<uint64_t>());
+    ReadBytes(reinterpret_cast<char*>(_values.data()), _values.size() * sizeof(P));
+    return _values;
+}
+
+#endif
@@ -11,10 +11,73 @@
 #include <fstream>
 #include <vector>
 #include <map>
+#include <string_view>
+#include <iostream>
+#include <algorithm>
 #include "utilities.hpp"
+#include "bytesource.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
 
 using namespace std;
 
+/**
+ * A run of messages handed over at once, viewed in place.
+ * Type V is the message type.
+ */
+template<typename V>
+class Span
+{
+
+public:
+
+    // ctor
+    Span(V* _data, size_t _size) : data(_data), count(_size) {}
+    Span(vector<V>& _data) : data(_data.data()), count(_data.size()) {}
+
+    V* begin() const { return data; }
+    V* end() const { return data + count; }
+    V& operator[](size_t _index) const { return data[_index]; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+private:
+    V* data;
+    size_t count;
+};
+
+// messages a Connector batches at most
+const size_t MAX_BATCH_SIZE = 64;
+
+/**
+ * Size of the next batch a Connector forms: one message while the feed is idle,
+ * doubling while batches fill up, halving once the input runs out before a batch is full.
+ */
+class AdaptiveBatchSize
+{
+
+public:
+
+    // ctor
+    AdaptiveBatchSize(size_t _max = MAX_BATCH_SIZE) : size(1), limit(max(_max, size_t(1))) {}
+
+    // Get the size of the next batch
+    size_t Get() const { return size; }
+
+    // A batch filled up, so more input is waiting
+    void Filled() { size = min(size * 2, limit); }
+
+    // The input ran out before the batch filled
+    void Drained() { size = max(size / 2, size_t(1)); }
+
+    // Set the largest batch, 1 to hand over every message on its own
+    void SetMax(size_t _max) { limit = max(_max, size_t(1)); size = min(size, limit); }
+
+private:
+    size_t size;
+    size_t limit;
+};
+
 /**
  * Definition of a generic base class ServiceListener to listen to add, update, and remve
  * events on a Service. This listener should be registered on a Service for the Service
@@ -35,6 +98,9 @@ public:
   // Listener callback to process an update event to the Service
   virtual void ProcessUpdate(V &data) = 0;
 
+  // Listener callback to process a run of add events, in order; one at a time unless overridden
+  virtual void ProcessAddBatch(Span<V> _data) { for (V& d : _data) ProcessAdd(d); }
+
 };
 
 /**
@@ -53,6 +119,9 @@ public:
   // The callback that a Connector should invoke for any new or updated data
   virtual void OnMessage(V &data) = 0;
 
+  // The callback for a run of new or updated data, in order; one at a time unless overridden
+  virtual void OnMessageBatch(Span<V> _data) { for (V& d : _data) OnMessage(d); }
+
   // Add a listener to the Service for callbacks on add, remove, and update events
   // for data to the Service.
   virtual void AddListener(ServiceListener<V> *listener) = 0;
@@ -60,6 +129,12 @@ public:
   // Get all listeners on the Service.
   virtual const vector< ServiceListener<V>* >& GetListeners() const = 0;
 
+  // Get the counters of the Service
+  const ServiceMetrics& GetMetrics() const { return metrics; }
+
+protected:
+  ServiceMetrics metrics;
+
 };  
 
 /**
@@ -79,8 +154,47 @@ public:
   // Publish data to the Connector
   virtual void Publish(V &data) = 0;
 
-    // Subscribe data from the Connector
-    virtual void Subscribe(ifstream& _data) = 0;
+  // Subscribe data from a source, span by span, and finish it; returns the number of records accepted
+  long Subscribe(ByteSource& _source);
+
+  // Flow every record of a span of complete records into the Service, returns the number accepted;
+  // publish-only Connectors ignore it. Records are parsed in place and may not outlive the call;
+  // malformed ones are skipped.
+  virtual long ParseRecords(string_view /*_span*/) { return 0; }
+
+  // Finish the subscribed source after its last record
+  virtual void EndOfFeed() {}
+
+  // Get the number of malformed records skipped
+  long GetRejectedCount() const { return long(metrics.GetDropped()); }
+
+  // Get the counters of the Connector: records accepted in, messages published out, records rejected as dropped
+  const ServiceMetrics& GetMetrics() const { return metrics; }
+
+protected:
+
+  // Skip a malformed record, reporting the first one
+  void Reject(string_view _record, const exception& _error);
+
+  ServiceMetrics metrics;
 };
 
+template<typename V>
+long Connector<V>::Subscribe(ByteSource& _source)
+{
+    long _count = 0;
+    for (string_view _span; _source.Next(_span); ) {
+        _count += ParseRecords(_span);
+    }
+    EndOfFeed();
+    return _count;
+}
+
+template<typename V>
+void Connector<V>::Reject(string_view _record, const exception& _error)
+{
+    metrics.CountDropped();
+    if (metrics.GetDropped() == 1) std::cerr << "Rejected record " << _record << ": " << _error.what() << std::endl;
+}
+
 #endif
@@ -91,7 +91,7 @@ class StreamingService : public Service<string,PriceStream <T> >
 
 private:
 
-    map<string, PriceStream<T>> priceStreams;
+    ProductMap<PriceStream<T>> priceStreams;
     vector<ServiceListener<PriceStream<T>>*> listeners;
     ServiceListener<AlgoStream<T>>* listener;
 
@@ -104,8 +104,12 @@ public:
 
     // Callback for new or updated data
     void OnMessage(PriceStream<T>& data) {
+        TRACE_SCOPE("StreamingService::OnMessage");
+        TRACE_PRODUCT(data.GetProduct());
+        this->metrics.CountIn();
         string id = data.GetProduct().GetProductId();
         priceStreams[id] = data;
+        this->metrics.SetStateSize(priceStreams.Size());
     }
 
     // Add a listener to the Service for callbacks on add, remove, and update events for data to the Service
@@ -119,17 +123,31 @@ public:
 
     // Publish two-way prices
     void PublishPrice(PriceStream<T>& priceStream);
+
+    // Publish a run of two-way prices, handing them to each listener at once
+    void PublishPriceBatch(Span<PriceStream<T>> priceStreams);
 };
 
 template<typename T>
 void StreamingService<T>::PublishPrice(PriceStream<T>& _priceStream)
 {
+    FanOutTimer _timer(this->metrics);
     for (auto& l : listeners)
     {
         l->ProcessAdd(_priceStream);
     }
 }
 
+template<typename T>
+void StreamingService<T>::PublishPriceBatch(Span<PriceStream<T>> _priceStreams)
+{
+    FanOutTimer _timer(this->metrics, _priceStreams.size());
+    for (auto& l : listeners)
+    {
+        l->ProcessAddBatch(_priceStreams);
+    }
+}
+
 /*
 PriceStreamOrder::PriceStreamOrder(double _price, long _visibleQuantity, long _hiddenQuantity, PricingSide _side)
 {
@@ -189,6 +207,7 @@ class StreamingToAlgoStreamingListener : public ServiceListener<AlgoStream<T>>
 
 private:
     StreamingService<T>* service;
+    vector<PriceStream<T>> batch;
 
 public:
 
@@ -198,11 +217,25 @@ public:
 
     // Listener callback to process an add event
     void ProcessAdd(AlgoStream<T>& data) {
+        TRACE_SCOPE("StreamingToAlgoStreamingListener::ProcessAdd");
+        TRACE_PRODUCT(data.GetPriceStream()->GetProduct());
         PriceStream<T>* priceStream = data.GetPriceStream();
         service->OnMessage(*priceStream);
         service->PublishPrice(*priceStream);
     }
 
+    // Listener callback to process a run of add events
+    void ProcessAddBatch(Span<AlgoStream<T>> data) {
+        TRACE_SCOPE("StreamingToAlgoStreamingListener::ProcessAddBatch");
+        batch.clear();
+        for (auto& d : data) {
+            PriceStream<T>* priceStream = d.GetPriceStream();
+            service->OnMessage(*priceStream);
+            batch.push_back(*priceStream);
+        }
+        service->PublishPriceBatch(Span<PriceStream<T>>(batch));
+    }
+
     // Process a remove event to the Service
     void ProcessRemove(AlgoStream<T>& data){}
 
@@ -0,0 +1,272 @@
+/**
+ * trace.hpp
+ * Defines trace points recording when each step of a message through the system began and ended:
+ * connector parsing, Service OnMessage, listener ProcessAdd and historical persisting.
+ * Trace points are compiled in with -DTRADING_TRACE and compile to nothing otherwise.
+ * Each thread records into a ring buffer of its own, without a lock, keeping its last
+ * TRACE_BUFFER_EVENTS events; timestamps are read off the time stamp counter.
+ * WriteTrace dumps every buffer to a binary file, which tracetojson.cpp turns into Chrome trace JSON.
+ *
+ * @author Lexie Zhu
+ */
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <stdexcept>
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "productregistry.hpp"
+
+using namespace std;
+
+// events each thread keeps, the oldest overwritten first
+const size_t TRACE_BUFFER_EVENTS = 1 << 18;
+
+const uint32_t TRACE_MAGIC = 0x45435254; // "TRCE"
+
+// Read the time stamp counter, or nanoseconds of the steady clock without one
+inline uint64_t TraceTicks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return uint64_t(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+/**
+ * One traced step; the product is its handle plus one, 0 if none.
+ */
+struct TraceEvent
+{
+    const char* name;
+    uint32_t product;
+    uint64_t begin;
+    uint64_t end;
+};
+
+/**
+ * Header of a trace file, followed by the event names, the products and the events of each thread.
+ */
+struct TraceFileHeader
+{
+    uint32_t magic;
+    uint32_t names;
+    uint32_t products;
+    uint32_t threads;
+    double ticksPerMicrosecond;
+};
+
+/**
+ * An event as written to a trace file, its name an index into the names.
+ */
+struct TraceRecord
+{
+    uint32_t name;
+    uint32_t product;
+    uint64_t begin;
+    uint64_t end;
+};
+
+static_assert(sizeof(TraceFileHeader) == 24 && sizeof(TraceRecord) == 24, "trace file layout");
+
+/**
+ * Ring of the latest events of one thread; only that thread writes to it.
+ */
+class TraceBuffer
+{
+
+public:
+
+    // ctor; the ring is not touched until events are recorded
+    TraceBuffer(uint32_t _thread) : thread(_thread), events(new TraceEvent[TRACE_BUFFER_EVENTS]), recorded(0) {}
+
+    void Record(const char* _name, uint32_t _product, uint64_t _begin, uint64_t _end)
+    {
+        TraceEvent& _event = events[recorded++ % TRACE_BUFFER_EVENTS];
+        _event.name = _name;
+        _event.product = _product;
+        _event.begin = _begin;
+        _event.end = _end;
+    }
+
+    void SetName(const string& _name) { name = _name; }
+    const string& GetName() const { return name; }
+    uint32_t GetThread() const { return thread; }
+
+    // Get the events kept, oldest first
+    vector<TraceEvent> GetEvents() const;
+
+private:
+    uint32_t thread;
+    string name;
+    unique_ptr<TraceEvent[]> events;
+    uint64_t recorded;
+};
+
+vector<TraceEvent> TraceBuffer::GetEvents() const
+{
+    uint64_t _first = recorded > TRACE_BUFFER_EVENTS ? recorded - TRACE_BUFFER_EVENTS : 0;
+    vector<TraceEvent> _events;
+    _events.reserve(size_t(recorded - _first));
+    for (uint64_t i = _first; i < recorded; i++) _events.push_back(events[i % TRACE_BUFFER_EVENTS]);
+    return _events;
+}
+
+/**
+ * The trace buffers of the process, one per thread that recorded an event.
+ * Buffers outlive their threads, so a trace can be written once the threads are done.
+ */
+class Tracer
+{
+
+public:
+
+    // Get the tracer of the process
+    static Tracer& Instance();
+
+    // Get the buffer of the calling thread, made on its first event
+    TraceBuffer& GetBuffer();
+
+    // Name the calling thread in the trace
+    void SetThreadName(const string& _name) { GetBuffer().SetName(_name); }
+
+    // Write every buffer to a trace file once the traced threads have stopped, returns the number of events written;
+    // throws runtime_error if the file cannot be written
+    long Write(const string& _path);
+
+private:
+    Tracer() : startTicks(TraceTicks()), startTime(chrono::steady_clock::now()) {}
+
+    mutex lock;
+    vector<unique_ptr<TraceBuffer>> buffers;
+
+    // the counter's rate is measured over the life of the tracer
+    uint64_t startTicks;
+    chrono::steady_clock::time_point startTime;
+};
+
+Tracer& Tracer::Instance()
+{
+    static Tracer _tracer;
+    return _tracer;
+}
+
+TraceBuffer& Tracer::GetBuffer()
+{
+    static thread_local TraceBuffer* _buffer = nullptr;
+    if (!_buffer) {
+        lock_guard<mutex> _guard(lock);
+        buffers.emplace_back(new TraceBuffer(uint32_t(buffers.size() + 1)));
+        _buffer = buffers.back().get();
+    }
+    return *_buffer;
+}
+
+long Tracer::Write(const string& _path)
+{
+    lock_guard<mutex> _guard(lock);
+    double _micros = chrono::duration<double, micro>(chrono::steady_clock::now() - startTime).count();
+    uint64_t _ticks = TraceTicks() - startTicks;
+
+    // names and products are written once and referred to by index
+    vector<vector<TraceEvent>> _events;
+    map<const char*, uint32_t> _nameIndex;
+    vector<const char*> _names;
+    map<uint32_t, string> _products;
+    for (auto& b : buffers) {
+        _events.push_back(b->GetEvents());
+        for (auto& e : _events.back()) {
+            if (_nameIndex.emplace(e.name, uint32_t(_names.size())).second) _names.push_back(e.name);
+            if (e.product && !_products.count(e.product)) {
+                _products[e.product] = ProductRegistry::Instance().Get(e.product - 1).GetProductId();
+            }
+        }
+    }
+
+    ofstream _file(_path, ios::binary | ios::trunc);
+    auto _writeString = [&_file](const string& _text) {
+        uint32_t _length = uint32_t(_text.size());
+        _file.write(reinterpret_cast<const char*>(&_length), sizeof(_length));
+        _file.write(_text.data(), _length);
+    };
+    TraceFileHeader _header{ TRACE_MAGIC, uint32_t(_names.size()), uint32_t(_products.size()), uint32_t(buffers.size()),
+                             _micros > 0 ? _ticks / _micros : 1.0 };
+    _file.write(reinterpret_cast<const char*>(&_header), sizeof(_header));
+    for (const char* n : _names) _writeString(n);
+    for (auto& p : _products) {
+        _file.write(reinterpret_cast<const char*>(&p.first), sizeof(p.first));
+        _writeString(p.second);
+    }
+
+    long _count = 0;
+    for (size_t t = 0; t < buffers.size(); t++) {
+        uint32_t _thread = buffers[t]->GetThread();
+        uint64_t _size = _events[t].size();
+        _file.write(reinterpret_cast<const char*>(&_thread), sizeof(_thread));
+        _writeString(buffers[t]->GetName());
+        _file.write(reinterpret_cast<const char*>(&_size), sizeof(_size));
+        for (auto& e : _events[t]) {
+            TraceRecord _record{ _nameIndex[e.name], e.product, e.begin, e.end };
+            _file.write(reinterpret_cast<const char*>(&_record), sizeof(_record));
+        }
+        _count += long(_size);
+    }
+    _file.close();
+    if (!_file) throw runtime_error("Cannot write " + _path);
+    return _count;
+}
+
+/**
+ * Records a step from its construction to the end of its scope in the buffer of its thread.
+ */
+class TraceScope
+{
+
+public:
+
+    // ctor; the name must outlive the trace, as a string literal does
+    TraceScope(const char* _name) : name(_name), product(0), begin(TraceTicks()) {}
+
+    ~TraceScope() { Tracer::Instance().GetBuffer().Record(name, product, begin, TraceTicks()); }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    // Tag the step with the product it handles, so its messages can be followed through the trace
+    void SetProduct(string_view _productId)
+    {
+        ProductHandle _handle;
+        if (ProductRegistry::Instance().Find(_productId, _handle)) product = _handle + 1;
+    }
+
+private:
+    const char* name;
+    uint32_t product;
+    uint64_t begin;
+};
+
+#ifdef TRADING_TRACE
+// Trace the rest of the enclosing scope as a step of the given name
+#define TRACE_SCOPE(_name) TraceScope _traceScope(_name)
+// Tag the step traced in this scope with a product
+#define TRACE_PRODUCT(_product) _traceScope.SetProduct((_product).GetProductId())
+// Name the calling thread in the trace
+#define TRACE_THREAD(_name) Tracer::Instance().SetThreadName(_name)
+#else
+#define TRACE_SCOPE(_name)
+#define TRACE_PRODUCT(_product)
+#define TRACE_THREAD(_name)
+#endif
+
+#endif
@@ -0,0 +1,121 @@
+/** Converts a trace file written by a build with -DTRADING_TRACE to Chrome trace JSON,
+* for chrome://tracing or https://ui.perfetto.dev.
+* Usage: tracetojson <trace.bin> [<trace.json>]
+* Every traced step becomes a complete event on the track of its thread, tagged with its product,
+* so one order book can be followed from its parse through every listener it reached.
+* Times are in microseconds from the first event. Without an output name the JSON is written to <trace.bin>.json.
+* Compile it like main.cpp: g++ -std=c++17 -O2 tracetojson.cpp -o tracetojson
+* @author: Lexie Zhu
+*/
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include "trace.hpp"
+
+// Read a value of a trace file, throws runtime_error if it is cut short
+template<typename V>
+V ReadValue(istream& _in)
+{
+    V _value;
+    if (!_in.read(reinterpret_cast<char*>(&_value), sizeof(_value))) throw runtime_error("Truncated trace file");
+    return _value;
+}
+
+string ReadText(istream& _in)
+{
+    uint32_t _length = ReadValue<uint32_t>(_in);
+    string _text(_length, '\0');
+    if (!_in.read(&_text[0], _length)) throw runtime_error("Truncated trace file");
+    return _text;
+}
+
+// Quote a string for JSON
+string Quote(const string& _text)
+{
+    string _quoted = "\"";
+    for (char c : _text) {
+        if (c == '"' || c == '\\') _quoted += '\\';
+        if (static_cast<unsigned char>(c) >= 0x20) _quoted += c;
+    }
+    return _quoted + "\"";
+}
+
+struct TraceThread
+{
+    uint32_t id;
+    string name;
+    vector<TraceRecord> records;
+};
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: tracetojson <trace.bin> [<trace.json>]" << std::endl;
+        return 1;
+    }
+    string inPath = argv[1];
+    string outPath = argc > 2 ? argv[2] : inPath + ".json";
+
+    TraceFileHeader header;
+    vector<string> names;
+    map<uint32_t, string> products;
+    vector<TraceThread> threads;
+    try {
+        ifstream in(inPath, ios::binary);
+        if (!in) throw runtime_error("Cannot open " + inPath);
+        header = ReadValue<TraceFileHeader>(in);
+        if (header.magic != TRACE_MAGIC) throw runtime_error(inPath + " is not a trace file");
+        for (uint32_t i = 0; i < header.names; i++) names.push_back(ReadText(in));
+        for (uint32_t i = 0; i < header.products; i++) {
+            uint32_t product = ReadValue<uint32_t>(in);
+            products[product] = ReadText(in);
+        }
+        for (uint32_t i = 0; i < header.threads; i++) {
+            TraceThread thread;
+            thread.id = ReadValue<uint32_t>(in);
+            thread.name = ReadText(in);
+            thread.records.resize(ReadValue<uint64_t>(in));
+            for (auto& r : thread.records) {
+                r = ReadValue<TraceRecord>(in);
+                if (r.name >= header.names) throw runtime_error("Corrupt trace file");
+            }
+            threads.push_back(move(thread));
+        }
+    }
+    catch (const exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    // times count from the first event of any thread
+    uint64_t origin = UINT64_MAX;
+    for (auto& t : threads) {
+        for (auto& r : t.records) origin = min(origin, r.begin);
+    }
+
+    ofstream out(outPath, ios::trunc);
+    out << fixed << setprecision(3);
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"tradingsystem\"}}";
+    long events = 0;
+    for (auto& t : threads) {
+        string name = t.name.empty() ? "thread " + to_string(t.id) : t.name;
+        out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << t.id << ",\"args\":{\"name\":" << Quote(name) << "}}";
+        for (auto& r : t.records) {
+            out << ",\n{\"name\":" << Quote(names[r.name]) << ",\"cat\":\"trading\",\"ph\":\"X\",\"pid\":1,\"tid\":" << t.id
+                << ",\"ts\":" << (r.begin - origin) / header.ticksPerMicrosecond
+                << ",\"dur\":" << (r.end - r.begin) / header.ticksPerMicrosecond;
+            auto product = products.find(r.product);
+            if (product != products.end()) out << ",\"args\":{\"product\":" << Quote(product->second) << "}";
+            out << "}";
+            events++;
+        }
+    }
+    out << "\n]}\n";
+    out.close();
+    if (!out) {
+        std::cerr << "Cannot write " << outPath << std::endl;
+        return 1;
+    }
+    std::cout << events << " events of " << threads.size() << " threads written to " << outPath << "." << std::endl;
+    return 0;
+}
@@ -9,8 +9,16 @@
 
 #include <string>
 #include <vector>
+#include <map>
+#include <stdexcept>
+#include <deque>
 #include "executionservice.hpp"
 #include "soa.hpp"
+#include "compactmessages.hpp"
+#include "journal.hpp"
+#include "hashindex.hpp"
+#include "archive.hpp"
+#include "snapshot.hpp"
 
 // Trade sides
 enum Side { BUY, SELL };
@@ -47,6 +55,10 @@ public:
     // Get the side
     Side GetSide() const;
 
+    // Convert to and from the fixed layout
+    CompactTrade ToCompact() const;
+    static Trade<T> FromCompact(const CompactTrade& _compact);
+
 private:
     T product;
     string tradeId;
@@ -65,9 +77,15 @@ class TradeBookingConnector;
 template<typename T>
 class TradeBookingToExecutionListener;
 
+// booked trades kept live before they are archived
+const size_t TRADE_HOT_CAPACITY = 1024;
+
 /**
  * Trade Booking Service to book trades to a particular book.
  * Keyed on trade id.
+ * Trades are indexed by an open-addressing hash on trade id, so a trade seen
+ * before (replay or retransmit) is rejected in O(1) and booked exactly once.
+ * Booked trades beyond the retention policy move to a compact archive, still retrievable by id.
  * Type T is the product type.
  */
 template<typename T>
@@ -75,36 +93,51 @@ class TradeBookingService : public Service<string, Trade <T> >
 {
 
 private:
-    map<string, Trade<T>> trades;
+    vector<Trade<T>> trades;
+    OpenAddressingIndex tradeIndex;
+    vector<uint32_t> freeSlots;
+    deque<uint32_t> bookedOrder;
+    RecordArchive<CompactTrade> archive;
+    RetentionPolicy retention;
+    map<string, Trade<T>> recalled; // archived trades handed out by GetData, one per id
+    long duplicateCount;
     vector<ServiceListener<Trade<T>>*> listeners;
     TradeBookingConnector<T>* connector;
     TradeBookingToExecutionListener<T>* listener;
 
+    // Archive the oldest booked trades beyond the hot capacity
+    void Retain();
+
 public:
 
     //Ctor
     TradeBookingService()
     {
-        trades = map<string, Trade<T>>();
+        trades = vector<Trade<T>>();
+        retention = RetentionPolicy{ TRADE_HOT_CAPACITY };
+        duplicateCount = 0;
         listeners = vector<ServiceListener<Trade<T>>*>();
         connector = new TradeBookingConnector<T>(this);
         listener = new TradeBookingToExecutionListener<T>(this);
     }
 
-    // Get data by key
+    // Get data by key, from the live trades or else the archive, throws out_of_range for an unknown id
     Trade<T>& GetData(string _key){
-        return trades[_key];
+        uint32_t _slot;
+        if (tradeIndex.Find(_key, _slot)) return trades[_slot];
+
+        auto _it = recalled.find(_key);
+        if (_it != recalled.end()) return _it->second;
+        CompactTrade _compact;
+        if (!archive.Find(_key, _compact)) throw out_of_range("Trade " + _key + " is not booked");
+        return recalled.emplace(_key, Trade<T>::FromCompact(_compact)).first->second;
     };
 
     // Callback for any new or updated data
     void OnMessage(Trade<T>& _data){
-        string _id = _data.GetTradeId();
-        trades[_id] = _data;
-
-        for (auto& l : listeners)
-        {
-            l->ProcessAdd(_data);
-        }
+        TRACE_SCOPE("TradeBookingService::OnMessage");
+        TRACE_PRODUCT(_data.GetProduct());
+        BookTrade(_data);
     };
 
     // Add a listener to the Service for callbacks on add, remove, and update events for data to the Service
@@ -127,14 +160,125 @@ public:
         return listener;
     };
 
-    // Book the trade
-    void BookTrade(Trade<T>& _trade){
+    // Book the trade, false if its trade id was already booked
+    bool BookTrade(Trade<T>& _trade);
+
+    // Get the number of trades rejected as duplicates
+    long GetDuplicateCount() const{
+        return duplicateCount;
+    };
+
+    // Set how many booked trades stay live
+    void SetRetention(const RetentionPolicy& _retention){
+        retention = _retention;
+        Retain();
+    };
+
+    // Get the number of live trades
+    size_t GetLiveCount() const{
+        return tradeIndex.Size();
+    };
+
+    // Get the archive of booked trades
+    const RecordArchive<CompactTrade>& GetArchive() const{
+        return archive;
+    };
+
+    // Save the live and archived trades to a snapshot
+    void SaveSnapshot(SnapshotWriter& _writer);
+
+    // Restore the live and archived trades from a snapshot
+    void LoadSnapshot(SnapshotReader& _reader);
+};
+
+template<typename T>
+void TradeBookingService<T>::SaveSnapshot(SnapshotWriter& _writer)
+{
+    vector<CompactTrade> _live;
+    for (uint32_t _slot : bookedOrder)
+    {
+        _live.push_back(trades[_slot].ToCompact());
+    }
+    _writer.BeginSection("TRDS");
+    _writer.WriteVector(_live);
+    _writer.WriteVector(archive.GetRecords());
+    _writer.Write(static_cast<int64_t>(duplicateCount));
+    _writer.Write(static_cast<int64_t>(listener->GetTradeBookCount()));
+}
+
+template<typename T>
+void TradeBookingService<T>::LoadSnapshot(SnapshotReader& _reader)
+{
+    _reader.BeginSection("TRDS");
+    trades.clear();
+    tradeIndex.Clear();
+    freeSlots.clear();
+    bookedOrder.clear();
+    archive = RecordArchive<CompactTrade>();
+    recalled.clear();
+
+    // ids generated from here on must not collide with the trades restored
+    for (auto& c : _reader.ReadVector<CompactTrade>())
+    {
+        IdGenerator::Reserve(c.tradeId.Get());
+        tradeIndex.Insert(c.tradeId.Get(), static_cast<uint32_t>(trades.size()));
+        bookedOrder.push_back(static_cast<uint32_t>(trades.size()));
+        trades.push_back(Trade<T>::FromCompact(c));
+    }
+    for (auto& c : _reader.ReadVector<CompactTrade>())
+    {
+        IdGenerator::Reserve(c.tradeId.Get());
+        archive.Append(c.tradeId.Get(), c);
+    }
+    duplicateCount = static_cast<long>(_reader.Read<int64_t>());
+    listener->SetTradeBookCount(static_cast<long>(_reader.Read<int64_t>()));
+    this->metrics.SetStateSize(tradeIndex.Size());
+}
+
+template<typename T>
+bool TradeBookingService<T>::BookTrade(Trade<T>& _trade)
+{
+    this->metrics.CountIn();
+    uint32_t _slot = freeSlots.empty() ? static_cast<uint32_t>(trades.size()) : freeSlots.back();
+    if (archive.Contains(_trade.GetTradeId()) || !tradeIndex.Insert(_trade.GetTradeId(), _slot))
+    {
+        duplicateCount++;
+        this->metrics.CountDropped();
+        return false;
+    }
+    if (_slot == trades.size()) {
+        trades.push_back(_trade);
+    }
+    else {
+        freeSlots.pop_back();
+        trades[_slot] = _trade;
+    }
+    bookedOrder.push_back(_slot);
+
+    {
+        FanOutTimer _timer(this->metrics);
         for (auto& l : listeners)
         {
             l->ProcessAdd(_trade);
         }
-    };
-};
+    }
+    Retain();
+    return true;
+}
+
+template<typename T>
+void TradeBookingService<T>::Retain()
+{
+    while (bookedOrder.size() > retention.hotCapacity)
+    {
+        uint32_t _slot = bookedOrder.front();
+        bookedOrder.pop_front();
+        archive.Append(trades[_slot].GetTradeId(), trades[_slot].ToCompact());
+        tradeIndex.Erase(trades[_slot].GetTradeId());
+        freeSlots.push_back(_slot);
+    }
+    this->metrics.SetStateSize(tradeIndex.Size());
+}
 
 template<typename T>
 Trade<T>::Trade(const T& _product, string _tradeId, double _price, string _book, long _quantity, Side _side) :
@@ -183,6 +327,26 @@ Side Trade<T>::GetSide() const
     return side;
 }
 
+template<typename T>
+CompactTrade Trade<T>::ToCompact() const
+{
+    CompactTrade _compact;
+    memset(&_compact, 0, sizeof(_compact));
+    _compact.tradeId.Set(tradeId);
+    memcpy(_compact.book, book.data(), min(book.size(), size_t(COMPACT_BOOK_WIDTH)));
+    _compact.product = GetProductHandle(product.GetProductId());
+    _compact.price = PriceToTicks(price);
+    _compact.quantity = quantity;
+    _compact.side = static_cast<uint8_t>(side);
+    return _compact;
+}
+
+template<typename T>
+Trade<T> Trade<T>::FromCompact(const CompactTrade& _compact)
+{
+    return Trade<T>(RetrieveProductByHandle(_compact.product), _compact.tradeId.Get(), TicksToPrice(_compact.price),
+                    string(_compact.book, strnlen(_compact.book, COMPACT_BOOK_WIDTH)), _compact.quantity, static_cast<Side>(_compact.side));
+}
 
 /**
 * Trade Booking Connector reading data to Trading Booking Service.
@@ -195,38 +359,65 @@ public:
     // Ctor
     TradeBookingConnector(TradeBookingService<T>* _service){
         service = _service;
+        journal = nullptr;
     };
 
     // Publish data to the Connector
     void Publish(Trade<T>& _data){};
 
-    // Subscribe data from the Connector
-    void Subscribe(ifstream& _data);
+    // Flow every trade record of a span into the Service
+    long ParseRecords(string_view _span);
+
+    // Journal every accepted trade, nullptr to stop
+    void SetJournal(Journal* _journal) { journal = _journal; }
 
 private:
+    // Flow one trade record, split into cells, into the Service
+    void ProcessRecord();
+
     TradeBookingService<T>* service;
+    Journal* journal;
+    vector<string_view> cells;
 
 };
 
 // Read data from the txt file, build the trades and update into the system.
 template<typename T>
-void TradeBookingConnector<T>::Subscribe(ifstream& dataStream)
+long TradeBookingConnector<T>::ParseRecords(string_view dataSpan)
 {
-    for (string line; getline(dataStream, line); )
-    {
-        vector<string> cells = SplitLine(line);
-
-        string productId = cells[0];
-        string tradeId = cells[1];
-        double price = ConvertStringToPrice(cells[2]);
-        string book = cells[3];
-        long quantity = stol(cells[4]);
-        Side side = (cells[5] == "BUY") ? BUY : SELL;
-        T product = RetrieveProduct(productId);
-
-        Trade<T> trade(product, tradeId, price, book, quantity, side);
-        service->OnMessage(trade);
+    long count = 0;
+    for (string_view record; NextRecord(dataSpan, record, cells); ) {
+        try {
+            ProcessRecord();
+            count++;
+        }
+        catch (const exception& e) {
+            this->Reject(record, e);
+        }
     }
+    this->metrics.CountIn(count);
+    return count;
+}
+
+template<typename T>
+void TradeBookingConnector<T>::ProcessRecord()
+{
+    TRACE_SCOPE("TradeBookingConnector::ParseRecord");
+    if (cells.size() < 6) throw invalid_argument("Malformed trade record");
+
+    string_view productId = cells[0];
+    string tradeId(cells[1]);
+    CheckCompactId(tradeId);
+    double price = ConvertStringToPrice(cells[2]);
+    string book(cells[3]);
+    long quantity = ParseLong(cells[4]);
+    Side side = (cells[5] == "BUY") ? BUY : SELL;
+    T product = RetrieveProduct(productId);
+    TRACE_PRODUCT(product);
+
+    Trade<T> trade(product, tradeId, price, book, quantity, side);
+    if (journal) journal->Append(JOURNAL_TRADE, trade.ToCompact());
+    service->OnMessage(trade);
 }
 
 /**
@@ -253,6 +444,10 @@ public:
     // Listener callback to process an update event to the Service
     void ProcessUpdate(ExecutionOrder<T>& _data) {};
 
+    // Get and set the number of executions booked, which picks the book
+    long GetTradeBookCount() const { return tradeBookCount; };
+    void SetTradeBookCount(long _count) { tradeBookCount = _count; };
+
 private:
 
     TradeBookingService<T>* service;
@@ -263,6 +458,8 @@ private:
 template<typename T>
 void TradeBookingToExecutionListener<T>::ProcessAdd(ExecutionOrder<T>& executionData)
 {
+    TRACE_SCOPE("TradeBookingToExecutionListener::ProcessAdd");
+    TRACE_PRODUCT(executionData.GetProduct());
     static const std::vector<std::string> marketVector = {"TRSY1", "TRSY2", "TRSY3"};
     tradeBookCount++;
 
@@ -279,7 +476,6 @@ void TradeBookingToExecutionListener<T>::ProcessAdd(ExecutionOrder<T>& execution
     long totalQuantity = visibleQuantity + hiddenQuantity;
 
     Trade<T> trade(product, orderId, price, book, totalQuantity, tradeSide);
-    service->OnMessage(trade);
     service->BookTrade(trade);
 }
 
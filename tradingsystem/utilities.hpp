@@ -13,9 +13,19 @@
 #include <map>
 #include <random>
 #include <cstdlib>
+#include <cstdint>
+#include <vector>
+#include <stdexcept>
+#include <string_view>
+#include <charconv>
+#include <system_error>
 #include <time.h>
+#include <cstdio>
 #include <fstream>
 #include "products.hpp"
+#include "idgenerator.hpp"
+#include "clock.hpp"
+#include "productregistry.hpp"
 #include <boost/date_time/gregorian/gregorian.hpp>
 
 using namespace std;
@@ -34,61 +44,51 @@ std::vector<string> SplitLine(string line) {
     return cells;
 }
 
-// Obtain the PV01 value
+// separate a line in place: the cells point into the line, nothing is copied
+void SplitLine(string_view line, vector<string_view>& cells) {
+    cells.clear();
+    size_t start = 0;
+    for (size_t end; (end = line.find(',', start)) != string_view::npos; start = end + 1) {
+        cells.push_back(line.substr(start, end - start));
+    }
+    if (start < line.size()) cells.push_back(line.substr(start));
+}
+
+// parse a whole cell as an integer, throws invalid_argument if it is not one
+long ParseLong(string_view cell) {
+    long value = 0;
+    auto result = from_chars(cell.data(), cell.data() + cell.size(), value);
+    if (result.ec != errc() || result.ptr != cell.data() + cell.size()) throw invalid_argument("Not an integer: " + string(cell));
+    return value;
+}
+
+// Obtain the PV01 value, 0 if unknown
 double GetPV01(string _id) {
-    map<string, double> PV01Map({
-                                        {"91282CJL6", 0.01967211},
-                                        {"91282CHY0", 0.028849852},
-                                        {"91282CHX2", 0.048555605 },
-                                        {"91282CJM4", 0.068303332 },
-                                        {"91282CJJ1", 0.08071955 },
-                                        {"912810TM0", 0.118325668 },
-                                        {"912810TL2", 0.185319634 } });
-    return PV01Map[_id];
-}
-
-// create the maps: <maturity, <name, maturity_date>>
-const map<int, pair<string, date>> bondMap({
-                                                   {2, {"91282CJL6", {2025, Nov, 30}}},
-                                                   {3, {"91282CHY0", {2026, Sep, 15}}},
-                                                   {5, {"91282CHX2", {2028, Aug, 31}}},
-                                                   {7, {"91282CJM4", {2030, Nov, 30}}},
-                                                   {10, {"91282CJJ1", {2033, Nov, 15}}},
-                                                   {20, {"912810TM0", {2042, Nov, 30}}},
-                                                   {30, {"912810TL2", {2052, Nov, 15}}} });
-
-const map<string, int> bondIdMatMap({
-                                            {"91282CJL6", 2},
-                                            {"91282CHY0", 3},
-                                            {"91282CHX2", 5 },
-                                            {"91282CJM4", 7 },
-                                            {"91282CJJ1", 10 },
-                                            {"912810TM0", 20 },
-                                            {"912810TL2", 30 }});
-
-// the map between bond id and their coupons
-const map<string, double> bondIdCouponMap({
-                                                  {"91282CJL6", 0.04875},
-                                                  {"91282CHY0", 0.04625},
-                                                  {"91282CHX2", 0.04375},
-                                                  {"91282CJM4", 0.04375},
-                                                  {"91282CJJ1", 0.04500},
-                                                  {"912810TM0", 0.04000},
-                                                  {"912810TL2", 0.04000}});
+    ProductHandle _handle;
+    return ProductRegistry::Instance().Find(_id, _handle) ? ProductRegistry::Instance().GetPV01(_handle) : 0.0;
+}
 
+// Handle of the first security of a maturity (in years)
+ProductHandle FindMaturityIndex(int mat) {
+    const ProductRegistry& _registry = ProductRegistry::Instance();
+    for (size_t i = 0; i < _registry.Size(); i++) {
+        if (_registry.GetMaturityYears(static_cast<ProductHandle>(i)) == mat) return static_cast<ProductHandle>(i);
+    }
+    throw out_of_range("No security of maturity " + to_string(mat));
+}
 
 string FetchCusipId(int mat) {
-    string id = bondMap.at(mat).first;
-    return id;
+    return ProductRegistry::Instance().Get(FindMaturityIndex(mat)).GetProductId();
 }
 
-double ConvertStringToPrice(const string& str_price) {
+double ConvertStringToPrice(string_view str_price) {
     auto separate_pos = str_price.find('-');
+    if (separate_pos == string_view::npos || str_price.size() < separate_pos + 4) throw invalid_argument("Not a price: " + string(str_price));
 
     // integer part and float part(s)
-    double res = stoi(str_price.substr(0, separate_pos));
-    string xy = str_price.substr(separate_pos + 1, 2);
-    res += stoi(xy) / 32.0;
+    double res = ParseLong(str_price.substr(0, separate_pos));
+    string_view xy = str_price.substr(separate_pos + 1, 2);
+    res += ParseLong(xy) / 32.0;
     char z = str_price[str_price.size() - 1];
     if (z == '+') {
         res += 1.0 / 64.0;
@@ -125,40 +125,37 @@ string PriceToString(double price) {
     return res;
 }
 
-Bond RetrieveProduct(int mat) {
-    string id = bondMap.at(mat).first;
-    string ticker = "US" + to_string(mat) + "Y";
-    return Bond(id, CUSIP, ticker, bondIdCouponMap.at(id), bondMap.at(mat).second);
+// Get the handle of a product, throws out_of_range if unknown
+ProductHandle GetProductHandle(string_view _id) {
+    ProductHandle _handle;
+    if (!ProductRegistry::Instance().Find(_id, _handle)) throw out_of_range("Unknown CUSIP " + string(_id));
+    return _handle;
+}
+
+const Bond& RetrieveProduct(int mat) {
+    return ProductRegistry::Instance().Get(FindMaturityIndex(mat));
 }
 
-Bond RetrieveProduct(string _id) {
-    int _mat = bondIdMatMap.at(_id);
-    return RetrieveProduct(_mat);
+const Bond& RetrieveProduct(string_view _id) {
+    return ProductRegistry::Instance().Get(GetProductHandle(_id));
 }
 
-string GenerateTradingId(int length = 12)
+const Bond& RetrieveProductByHandle(ProductHandle _handle) {
+    return ProductRegistry::Instance().Get(_handle);
+}
+
+// Unique, fixed-width and sortable id; see idgenerator.hpp
+string GenerateTradingId(int length = ID_DEFAULT_WIDTH)
 {
-    thread_local random_device rd;
-    thread_local mt19937_64 gen(rd());
-    thread_local uniform_real_distribution<double> d(0.0, 1.0);
-
-    string _base = "WQAZSXCDERFVBGTYHNMJUIKLOP1472583690";
-    string ID = "";
-    for (int i = 0; i < length; i++) {
-        double _r = d(gen);
-        ID.push_back(_base[(int)(_r * 36)]);
-    }
-    return ID;
+    return IdGenerator::Next(length);
 }
 
-// get current time stamp
-string GetTimeStamp() {
-    auto curr_time = chrono::system_clock::now();
-    auto curr_time_t = chrono::system_clock::to_time_t(curr_time);
+// format a clock time as "YYYY-MM-DD HH:MM:SS.mmm" in local time
+string FormatTimeStamp(int64_t curr_time) {
+    time_t curr_time_t = static_cast<time_t>(curr_time / 1000000000);
 
     // milliseconed precision?
-    auto seconds = chrono::time_point_cast<chrono::seconds>(curr_time);
-    auto milliseconds = (chrono::duration_cast<chrono::milliseconds>(curr_time - seconds)).count();
+    long milliseconds = static_cast<long>(curr_time / 1000000 % 1000);
 
     string m_seconds;
     if (milliseconds < 10) {
@@ -171,19 +168,47 @@ string GetTimeStamp() {
         m_seconds = to_string(milliseconds);
     }
 
+    // localtime_r as timestamps are taken from several threads
+    struct tm local_tm;
+    localtime_r(&curr_time_t, &local_tm);
     char time_string[24];
-    strftime(time_string, 24, "%F %T", localtime(&curr_time_t));
+    strftime(time_string, 24, "%F %T", &local_tm);
     return static_cast<string>(time_string) + "." + m_seconds;
 }
 
+// parse a time stamp written by FormatTimeStamp back to a clock time, -1 if malformed
+int64_t ParseTimeStamp(const string& time_stamp) {
+    struct tm local_tm = {};
+    int milliseconds = 0;
+    if (sscanf(time_stamp.c_str(), "%d-%d-%d %d:%d:%d.%d", &local_tm.tm_year, &local_tm.tm_mon, &local_tm.tm_mday,
+        &local_tm.tm_hour, &local_tm.tm_min, &local_tm.tm_sec, &milliseconds) != 7) {
+        return -1;
+    }
+    local_tm.tm_year -= 1900;
+    local_tm.tm_mon -= 1;
+    local_tm.tm_isdst = -1;
+    return (static_cast<int64_t>(mktime(&local_tm)) * 1000 + milliseconds) * 1000000;
+}
+
+// get current time stamp
+string GetTimeStamp() {
+    // read from the clock in use, so replayed records carry their event time
+    return FormatTimeStamp(ClockNow());
+}
+
+// Get the local date of the clock in use, so a replay trades on the date of its events
+date GetClockDate()
+{
+    time_t _seconds = static_cast<time_t>(ClockNow() / 1000000000);
+    struct tm local_tm;
+    localtime_r(&_seconds, &local_tm);
+    return date_from_tm(local_tm);
+}
+
 // Get current millisecond time
 long GetTime()
 {
-    auto timePoint = chrono::system_clock::now();
-    auto sec = chrono::time_point_cast<chrono::seconds>(timePoint);
-    auto time = chrono::duration_cast<chrono::milliseconds>(timePoint - sec);
-    long timeCount = static_cast<long>(time.count());
-    return timeCount;
+    return static_cast<long>(ClockNow() / 1000000 % 1000);
 }
 
 
@@ -0,0 +1,199 @@
+/**
+ * waitstrategy.hpp
+ * Defines how an idle consumer waits for a queued hand-off between services.
+ * Spinning strategies answer fastest but hold a core; blocking and backing off
+ * give the core away at the price of a slower wake-up.
+ *
+ * @author Lexie Zhu
+ */
+#ifndef WAIT_STRATEGY_HPP
+#define WAIT_STRATEGY_HPP
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <stdexcept>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+enum WaitStrategyType { WAIT_BUSY_SPIN, WAIT_SPIN_YIELD, WAIT_BLOCKING, WAIT_BACKOFF };
+
+// Tell the core we are spinning
+inline void CpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+/**
+ * Policy of a consumer with nothing to consume.
+ * Wait returns once _ready holds, or earlier, so the consumer checks its queue again.
+ */
+class WaitStrategy
+{
+
+public:
+
+    virtual ~WaitStrategy() {}
+
+    // Wait for _ready on the consumer thread
+    virtual void Wait(const function<bool()>& _ready) = 0;
+
+    // Wake the consumer once something is ready, on the producer thread
+    virtual void Signal() {}
+
+    // Get the strategy type
+    virtual WaitStrategyType GetType() const = 0;
+};
+
+/**
+ * Spins until ready; lowest latency, holds a core.
+ */
+class BusySpinWait : public WaitStrategy
+{
+
+public:
+
+    void Wait(const function<bool()>& _ready) override
+    {
+        while (!_ready()) CpuRelax();
+    }
+
+    WaitStrategyType GetType() const override { return WAIT_BUSY_SPIN; }
+};
+
+/**
+ * Spins for a while, then yields the core between checks.
+ */
+class SpinYieldWait : public WaitStrategy
+{
+
+public:
+
+    // ctor
+    SpinYieldWait(int _spins = 1000) : spins(_spins) {}
+
+    void Wait(const function<bool()>& _ready) override
+    {
+        for (int i = 0; !_ready(); i++) {
+            if (i < spins) CpuRelax();
+            else this_thread::yield();
+        }
+    }
+
+    WaitStrategyType GetType() const override { return WAIT_SPIN_YIELD; }
+
+private:
+    int spins;
+};
+
+/**
+ * Sleeps on a condition variable until signalled; the producer only
+ * takes the lock when the consumer is asleep. A missed wake-up is
+ * bounded by the timeout.
+ */
+class BlockingWait : public WaitStrategy
+{
+
+public:
+
+    // ctor
+    BlockingWait(chrono::microseconds _timeout = chrono::milliseconds(1)) : timeout(_timeout), sleepers(0) {}
+
+    void Wait(const function<bool()>& _ready) override
+    {
+        unique_lock<mutex> _guard(lock);
+        sleepers++;
+        wake.wait_for(_guard, timeout, _ready);
+        sleepers--;
+    }
+
+    void Signal() override
+    {
+        if (sleepers.load() == 0) return;
+        {
+            lock_guard<mutex> _guard(lock);
+        }
+        wake.notify_one();
+    }
+
+    WaitStrategyType GetType() const override { return WAIT_BLOCKING; }
+
+private:
+    chrono::microseconds timeout;
+    atomic<int> sleepers;
+    mutex lock;
+    condition_variable wake;
+};
+
+/**
+ * Sleeps between checks, doubling the sleep from a minimum to a maximum.
+ * Cheapest for consumers that can afford to lag, like the historical writers.
+ */
+class BackoffWait : public WaitStrategy
+{
+
+public:
+
+    // ctor
+    BackoffWait(chrono::microseconds _min = chrono::microseconds(1), chrono::microseconds _max = chrono::milliseconds(1)) : min(_min), max(_max) {}
+
+    void Wait(const function<bool()>& _ready) override
+    {
+        for (chrono::microseconds _sleep = min; !_ready(); _sleep = std::min(_sleep * 2, max)) {
+            this_thread::sleep_for(_sleep);
+        }
+    }
+
+    WaitStrategyType GetType() const override { return WAIT_BACKOFF; }
+
+private:
+    chrono::microseconds min;
+    chrono::microseconds max;
+};
+
+// Make a wait strategy of a type
+unique_ptr<WaitStrategy> MakeWaitStrategy(WaitStrategyType _type)
+{
+    switch (_type)
+    {
+    case WAIT_BUSY_SPIN: return unique_ptr<WaitStrategy>(new BusySpinWait());
+    case WAIT_SPIN_YIELD: return unique_ptr<WaitStrategy>(new SpinYieldWait());
+    case WAIT_BACKOFF: return unique_ptr<WaitStrategy>(new BackoffWait());
+    default: return unique_ptr<WaitStrategy>(new BlockingWait());
+    }
+}
+
+// Names of the strategies, as given on the command line
+string WaitStrategyName(WaitStrategyType _type)
+{
+    switch (_type)
+    {
+    case WAIT_BUSY_SPIN: return "busy-spin";
+    case WAIT_SPIN_YIELD: return "spin-yield";
+    case WAIT_BACKOFF: return "backoff";
+    default: return "blocking";
+    }
+}
+
+// Parse a strategy name, throws invalid_argument if unknown
+WaitStrategyType ParseWaitStrategy(const string& _name)
+{
+    for (WaitStrategyType t : { WAIT_BUSY_SPIN, WAIT_SPIN_YIELD, WAIT_BLOCKING, WAIT_BACKOFF }) {
+        if (WaitStrategyName(t) == _name) return t;
+    }
+    throw invalid_argument("Unknown wait strategy " + _name);
+}
+
+#endif